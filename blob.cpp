@@ -0,0 +1,232 @@
+/* Copyright (C)
+ * 2012 - Paul Weingardt
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include "sqlitepp.h"
+
+namespace sqlitepp {
+
+    SQLiteException BlobNotOpened("The blob has not been opened or it has been closed.");
+
+    inline void BlobHandle::checkOpened() const {
+        if(!this->blob) {
+            throw BlobNotOpened;
+        }
+    }
+
+    BlobHandle::BlobHandle(Database& database, const std::string& table, const std::string& column,
+            const sqlite3_int64 rowid, const bool writable, const std::string& schema)
+        : db(database), table(table), schema(schema), rowid(rowid) {
+        if(!db.isOpen()) {
+            throw DatabaseNotOpened;
+        }
+
+        this->blob = NULL;
+        this->position = 0;
+
+        if(sqlite3_blob_open(this->db.database, schema.c_str(), table.c_str(), column.c_str(),
+                    rowid, writable ? 1 : 0, &this->blob) != SQLITE_OK) {
+            SQLiteException error(this->db.database);
+            sqlite3_blob_close(this->blob);
+            this->blob = NULL;
+            throw error;
+        }
+    }
+
+    BlobHandle::~BlobHandle(void) {
+        this->close();
+    }
+
+    void BlobHandle::reopen(const sqlite3_int64 rowid) {
+        this->checkOpened();
+
+        if(sqlite3_blob_reopen(this->blob, rowid) != SQLITE_OK) {
+            throw SQLiteException(this->db.database);
+        }
+        this->rowid = rowid;
+        this->position = 0;
+    }
+
+    int BlobHandle::size(void) const {
+        this->checkOpened();
+
+        return sqlite3_blob_bytes(this->blob);
+    }
+
+    int BlobHandle::read(void* buffer, const int size, const int offset) {
+        this->checkOpened();
+
+        int available = sqlite3_blob_bytes(this->blob) - offset;
+        int count = (size < available) ? size : available;
+        if(count <= 0) {
+            return 0;
+        }
+
+        if(sqlite3_blob_read(this->blob, buffer, count, offset) != SQLITE_OK) {
+            throw SQLiteException(this->db.database);
+        }
+        return count;
+    }
+
+    void BlobHandle::write(const void* data, const int size, const int offset) {
+        this->checkOpened();
+
+        if(offset < 0 || size > sqlite3_blob_bytes(this->blob) - offset) {
+            throw SQLiteException("Blob writes cannot change the size of the blob.");
+        }
+
+        if(sqlite3_blob_write(this->blob, data, size, offset) != SQLITE_OK) {
+            throw SQLiteException(this->db.database);
+        }
+
+        // incremental writes do not invoke the update hook
+        if(this->db.cache) {
+            this->db.cache->invalidate(this->table);
+        }
+
+        // with values, the preupdate hook records the change
+        if(this->db.changes && !this->db.changeValues) {
+            ChangeEvent event;
+            event.operation = CHANGE_UPDATE;
+            event.database = this->schema;
+            event.table = this->table;
+            event.rowid = this->rowid;
+            this->db.pendingChanges.push_back(event);
+        }
+    }
+
+    int BlobHandle::readChunk(void* buffer, const int size) {
+        int count = this->read(buffer, size, this->position);
+        this->position += count;
+        return count;
+    }
+
+    void BlobHandle::writeChunk(const void* data, const int size) {
+        this->write(data, size, this->position);
+        this->position += size;
+    }
+
+    void BlobHandle::seek(const int offset) {
+        this->position = offset;
+    }
+
+    void BlobHandle::close(void) {
+        if(this->blob) {
+            sqlite3_blob_close(this->blob);
+            this->blob = NULL;
+        }
+    }
+
+    BlobStreamBuf::BlobStreamBuf(BlobHandle& handle, const size_t chunk)
+        : blob(handle), buffer(chunk ? chunk : 1) {
+        this->base = 0;
+    }
+
+    BlobStreamBuf::~BlobStreamBuf(void) {
+        try {
+            this->flush();
+        } catch(SQLiteException&) {
+            // destructors must not throw, sync() reports errors
+        }
+    }
+
+    int BlobStreamBuf::tell(void) const {
+        if(this->gptr()) {
+            return this->base + (this->gptr() - this->eback());
+        }
+        if(this->pptr()) {
+            return this->base + (this->pptr() - this->pbase());
+        }
+        return this->base;
+    }
+
+    void BlobStreamBuf::flush(void) {
+        int position = this->tell();
+
+        if(this->pptr() && this->pptr() > this->pbase()) {
+            this->blob.write(this->pbase(), this->pptr() - this->pbase(), this->base);
+        }
+
+        this->setg(NULL, NULL, NULL);
+        this->setp(NULL, NULL);
+        this->base = position;
+    }
+
+    BlobStreamBuf::int_type BlobStreamBuf::underflow(void) {
+        this->flush();
+
+        int count = this->blob.read(&this->buffer[0], this->buffer.size(), this->base);
+        if(count == 0) {
+            return traits_type::eof();
+        }
+
+        this->setg(&this->buffer[0], &this->buffer[0], &this->buffer[0] + count);
+        return traits_type::to_int_type(*this->gptr());
+    }
+
+    BlobStreamBuf::int_type BlobStreamBuf::overflow(int_type c) {
+        this->flush();
+
+        int available = this->blob.size() - this->base;
+        int count = ((int) this->buffer.size() < available) ? this->buffer.size() : available;
+        if(count <= 0) {
+            return traits_type::eof();
+        }
+
+        this->setp(&this->buffer[0], &this->buffer[0] + count);
+        if(!traits_type::eq_int_type(c, traits_type::eof())) {
+            *this->pptr() = traits_type::to_char_type(c);
+            this->pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int BlobStreamBuf::sync(void) {
+        try {
+            this->flush();
+        } catch(SQLiteException&) {
+            return -1;
+        }
+        return 0;
+    }
+
+    BlobStreamBuf::pos_type BlobStreamBuf::seekoff(off_type offset, std::ios_base::seekdir direction,
+            std::ios_base::openmode) {
+        off_type position = offset;
+        if(direction == std::ios_base::cur) {
+            position += this->tell();
+        } else if(direction == std::ios_base::end) {
+            position += this->blob.size();
+        }
+
+        if(position < 0 || position > this->blob.size() || this->sync() != 0) {
+            return pos_type(off_type(-1));
+        }
+
+        this->base = position;
+        return pos_type(position);
+    }
+
+    BlobStreamBuf::pos_type BlobStreamBuf::seekpos(pos_type position, std::ios_base::openmode which) {
+        return this->seekoff(off_type(position), std::ios_base::beg, which);
+    }
+
+    BlobStream::BlobStream(BlobHandle& blob, const size_t chunk)
+        : std::iostream(NULL), buffer(blob, chunk) {
+        this->rdbuf(&this->buffer);
+    }
+}
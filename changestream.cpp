@@ -0,0 +1,57 @@
+/* Copyright (C)
+ * 2012 - Paul Weingardt
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include "sqlitepp.h"
+
+namespace sqlitepp {
+
+    ChangeStream::ChangeStream(const size_t capacity) : buffer(capacity) {
+        this->published.store(0);
+        this->dropped.store(0);
+    }
+
+    bool ChangeStream::publish(ChangeEvent& event) {
+        if(this->buffer.push(event)) {
+            this->published.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        this->dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    size_t ChangeStream::drain(std::vector<ChangeEvent>& events, const size_t max) {
+        size_t count = 0;
+        ChangeEvent event;
+
+        while((max == 0 || count < max) && this->buffer.pop(event)) {
+            events.push_back(std::move(event));
+            count++;
+        }
+
+        return count;
+    }
+
+    unsigned long ChangeStream::getPublished(void) const {
+        return this->published.load(std::memory_order_relaxed);
+    }
+
+    unsigned long ChangeStream::getDropped(void) const {
+        return this->dropped.load(std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,214 @@
+/* Copyright (C)
+ * 2012 - Paul Weingardt
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include "sqlitepp.h"
+
+namespace sqlitepp {
+
+    /**
+     * @brief runs a pragma and returns the first column of the first row
+     */
+    static std::string queryPragma(sqlite3* db, const char* sql) {
+        sqlite3_stmt* statement = NULL;
+        if(sqlite3_prepare_v2(db, sql, -1, &statement, NULL) != SQLITE_OK) {
+            throw SQLiteException(db);
+        }
+
+        std::string value;
+        if(sqlite3_step(statement) == SQLITE_ROW) {
+            const char* p = (const char*) sqlite3_column_text(statement, 0);
+            if(p) {
+                value = p;
+            }
+        }
+        sqlite3_finalize(statement);
+
+        return value;
+    }
+
+    CheckpointManager::CheckpointManager(Database& database, const CheckpointOptions& options)
+        : db(database), options(options) {
+        if(!db.isOpen()) {
+            throw DatabaseNotOpened;
+        }
+
+        this->connection = NULL;
+        this->pageSize = 0;
+        this->autocheckpoint = 1000;
+        this->walPages.store(0);
+        this->commits.store(0);
+        this->requested.store(false);
+        this->stopping = false;
+        this->stats = CheckpointStats();
+
+        const char* file = sqlite3_db_filename(this->db.database, "main");
+        if(!file || !*file) {
+            throw SQLiteException("Checkpoints need a database file.");
+        }
+
+        if(queryPragma(this->db.database, "PRAGMA journal_mode;") != "wal") {
+            throw SQLiteException("The database is not in WAL mode.");
+        }
+        this->autocheckpoint = atoi(queryPragma(this->db.database, "PRAGMA wal_autocheckpoint;").c_str());
+
+        if(sqlite3_open_v2(file, &this->connection, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK) {
+            SQLiteException error(this->connection);
+            sqlite3_close(this->connection);
+            throw error;
+        }
+        sqlite3_busy_timeout(this->connection, this->options.busyTimeout);
+
+        // the destructor does not run, if the constructor throws
+        try {
+            // a new connection only switches to WAL, once it has read the database
+            queryPragma(this->connection, "PRAGMA journal_mode;");
+            this->pageSize = atoi(queryPragma(this->connection, "PRAGMA page_size;").c_str());
+
+            this->thread = std::thread(&CheckpointManager::run, this);
+        } catch(...) {
+            sqlite3_close(this->connection);
+            throw;
+        }
+
+        // the hooks go last, nothing can fail after them.
+        // sqlite3_wal_autocheckpoint installs a wal hook itself, so it goes first.
+        sqlite3_wal_autocheckpoint(this->db.database, 0);
+        sqlite3_wal_hook(this->db.database, CheckpointManager::walHook, this);
+    }
+
+    CheckpointManager::~CheckpointManager(void) {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+        }
+        this->condition.notify_one();
+        this->thread.join();
+
+        if(this->db.isOpen()) {
+            sqlite3_wal_hook(this->db.database, NULL, NULL);
+            sqlite3_wal_autocheckpoint(this->db.database, this->autocheckpoint);
+        }
+
+        sqlite3_wal_checkpoint_v2(this->connection, NULL, SQLITE_CHECKPOINT_PASSIVE, NULL, NULL);
+        sqlite3_close(this->connection);
+    }
+
+    int CheckpointManager::walHook(void* data, sqlite3*, const char*, int pages) {
+        CheckpointManager* manager = (CheckpointManager*) data;
+
+        manager->walPages.store(pages, std::memory_order_relaxed);
+        manager->commits.fetch_add(1, std::memory_order_relaxed);
+
+        if(pages >= manager->options.passivePages) {
+            manager->requested.store(true);
+            // no lock on the commit path, a missed wakeup is caught by the interval
+            manager->condition.notify_one();
+        }
+
+        return SQLITE_OK;
+    }
+
+    void CheckpointManager::run(void) {
+        unsigned long checkpointed = 0;
+        std::unique_lock<std::mutex> lock(this->mutex);
+
+        while(!this->stopping) {
+            this->condition.wait_for(lock, std::chrono::milliseconds(this->options.interval),
+                    [this] { return this->stopping || this->requested.load(); });
+
+            if(this->stopping) {
+                break;
+            }
+
+            // the interval passed without new commits
+            unsigned long commits = this->commits.load();
+            if(!this->requested.exchange(false) && commits == checkpointed) {
+                continue;
+            }
+            checkpointed = commits;
+
+            lock.unlock();
+            this->checkpoint();
+            lock.lock();
+        }
+    }
+
+    void CheckpointManager::checkpoint(void) {
+        int pages = this->walPages.load();
+
+        int mode = SQLITE_CHECKPOINT_PASSIVE;
+        if(pages >= this->options.truncatePages) {
+            mode = SQLITE_CHECKPOINT_TRUNCATE;
+        } else if(pages >= this->options.restartPages) {
+            mode = SQLITE_CHECKPOINT_RESTART;
+        }
+
+        int log = 0;
+        int done = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int result = sqlite3_wal_checkpoint_v2(this->connection, NULL, mode, &log, &done);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // the WAL starts over, unless a commit has come in meanwhile
+        if(result == SQLITE_OK && mode != SQLITE_CHECKPOINT_PASSIVE) {
+            this->walPages.compare_exchange_strong(pages, 0);
+        }
+
+        std::lock_guard<std::mutex> lock(this->statsMutex);
+        switch(mode) {
+            case SQLITE_CHECKPOINT_PASSIVE:
+                this->stats.passive++;
+                break;
+
+            case SQLITE_CHECKPOINT_RESTART:
+                this->stats.restart++;
+                break;
+
+            case SQLITE_CHECKPOINT_TRUNCATE:
+                this->stats.truncate++;
+                break;
+        }
+
+        if(result == SQLITE_BUSY) {
+            this->stats.busy++;
+        }
+
+        this->stats.lastLogFrames = log;
+        this->stats.lastCheckpointedFrames = done;
+        this->stats.lastSeconds = seconds;
+        this->stats.totalSeconds += seconds;
+        if(seconds > this->stats.maxSeconds) {
+            this->stats.maxSeconds = seconds;
+        }
+    }
+
+    void CheckpointManager::requestCheckpoint(void) {
+        this->requested.store(true);
+        this->condition.notify_one();
+    }
+
+    CheckpointStats CheckpointManager::getStats(void) const {
+        std::lock_guard<std::mutex> lock(this->statsMutex);
+
+        CheckpointStats stats = this->stats;
+        stats.walPages = this->walPages.load();
+        // WAL header plus a header for each frame
+        stats.walBytes = stats.walPages ? 32 + stats.walPages * (size_t) (this->pageSize + 24) : 0;
+        return stats;
+    }
+}
@@ -48,6 +48,21 @@ namespace sqlitepp {
         this->isopen = this->transaction = false;
         this->database = NULL;
         this->lastResult = 0;
+        this->cache = NULL;
+        this->plans = NULL;
+        this->changes = NULL;
+        this->changeValues = false;
+        this->timeout = 0;
+        this->token = NULL;
+        this->progressInterval = 1000;
+        this->progressInstalled = false;
+        this->authorizerInstalled = false;
+        this->accessTarget = NULL;
+        this->activeDeadline = std::chrono::steady_clock::time_point::max();
+        this->activeToken = NULL;
+        this->timedOut = false;
+        this->timeouts.store(0);
+        this->interrupts.store(0);
     }
 
     void Database::open(const std::string& file, const OpenFlags flags) {
@@ -77,6 +92,8 @@ namespace sqlitepp {
         } else {
             this->isopen = true;
         }
+
+        this->installHooks();
     }
 
     void Database::activateForeignKeys(void) {
@@ -98,11 +115,51 @@ namespace sqlitepp {
     int Database::exec(const std::string& str) {
         this->checkDatabaseOpened();
 
-        this->lastResult = sqlite3_exec(this->database, str.c_str(), NULL, NULL, NULL);
-        if(this->lastResult != SQLITE_OK) {
-            throw SQLiteException(this->database);
+        // The statements are stepped one by one instead of sqlite3_exec, so
+        // the changed tables and the pending changes of each statement are
+        // known. The update hook does not see everything, e.g. schema changes
+        // or the truncate optimization.
+        std::chrono::steady_clock::time_point deadline = this->getDeadline(-1);
+        const char* next = str.c_str();
+        const char* end = str.c_str() + str.size();
+
+        while(next < end) {
+            sqlite3_stmt* statement = NULL;
+            TableAccess access;
+
+            this->lastResult = this->prepare(next, end - next, &statement, &next, access);
+            if(this->lastResult != SQLITE_OK) {
+                throw SQLiteException(this->database);
+            }
+
+            // statement is NULL for whitespace and comments
+            if(!statement) {
+                continue;
+            }
+
+            size_t mark = 0;
+            while((this->lastResult = this->step(statement, access, mark, deadline, this->token))
+                    == SQLITE_ROW) {
+            }
+
+            if(this->cache) {
+                this->cache->invalidate(access);
+            }
+
+            if(this->lastResult != SQLITE_DONE) {
+                SQLiteException error(this->database);
+                sqlite3_finalize(statement);
+
+                if(this->lastResult == SQLITE_INTERRUPT) {
+                    this->throwInterrupted();
+                }
+                throw error;
+            }
+
+            sqlite3_finalize(statement);
         }
 
+        this->lastResult = SQLITE_OK;
         return sqlite3_changes(this->database);
     }
 
@@ -156,14 +213,441 @@ namespace sqlitepp {
     void Database::close(void) {
         if(this->isopen) {
             if(this->transaction) {
-                this->rollback();
+                // the destructor calls close, so a failed rollback must not
+                // throw. sqlite3_close rolls back an open transaction anyway.
+                try {
+                    this->rollback();
+                } catch(const SQLiteException&) {
+                }
             }
 
+            this->disableQueryCache();
+            this->disablePlanAnalysis();
+            this->detachChangeStream();
+
             sqlite3_close(this->database);
             this->database = NULL;
+            this->progressInstalled = false;
+            this->authorizerInstalled = false;
             this->isopen = false;
             this->transaction = false;
         }
     }
-}
 
+    static ChangeOperation toChangeOperation(const int operation) {
+        switch(operation) {
+            case SQLITE_INSERT:
+                return CHANGE_INSERT;
+
+            case SQLITE_DELETE:
+                return CHANGE_DELETE;
+
+            default:
+                return CHANGE_UPDATE;
+        }
+    }
+
+    void Database::installHooks(void) {
+        // installed once, so the statements of the connection stay prepared
+        if(!this->authorizerInstalled) {
+            sqlite3_set_authorizer(this->database, Database::authorizer, this);
+            this->authorizerInstalled = true;
+        }
+
+        if(this->cache || this->changes) {
+            sqlite3_update_hook(this->database, Database::updateHook, this);
+            sqlite3_rollback_hook(this->database, Database::rollbackHook, this);
+        } else {
+            sqlite3_update_hook(this->database, NULL, NULL);
+            sqlite3_rollback_hook(this->database, NULL, NULL);
+        }
+
+        if(this->changes) {
+            sqlite3_commit_hook(this->database, Database::commitHook, this);
+        } else {
+            sqlite3_commit_hook(this->database, NULL, NULL);
+        }
+
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+        if(this->changes && this->changeValues) {
+            sqlite3_preupdate_hook(this->database, Database::preupdateHook, this);
+        } else {
+            sqlite3_preupdate_hook(this->database, NULL, NULL);
+        }
+#endif
+    }
+
+    int Database::prepare(const char* sql, const int bytes, sqlite3_stmt** statement,
+            const char** tail, TableAccess& access) {
+        this->accessTarget = &access;
+        int result = sqlite3_prepare_v2(this->database, sql, bytes, statement, tail);
+        this->accessTarget = NULL;
+        return result;
+    }
+
+    int Database::authorizer(void* data, int action, const char* arg1,
+            const char* arg2, const char*, const char*) {
+        Database* db = (Database*) data;
+
+        // statements prepared elsewhere, e.g. re-prepared after a schema change
+        if(!db->accessTarget) {
+            return SQLITE_OK;
+        }
+
+        return QueryCache::authorizer(db->accessTarget, action, arg1, arg2, NULL, NULL);
+    }
+
+    void Database::updateHook(void* data, int operation, const char* database,
+            const char* table, sqlite3_int64 rowid) {
+        Database* db = (Database*) data;
+
+        if(db->cache) {
+            db->cache->invalidate(table);
+        }
+
+        // with values, the preupdate hook records the change
+        if(db->changes && !db->changeValues) {
+            ChangeEvent event;
+            event.operation = toChangeOperation(operation);
+            event.database = database;
+            event.table = table;
+            event.rowid = rowid;
+            db->pendingChanges.push_back(event);
+        }
+    }
+
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+    static void toValue(sqlite3_value* value, Value& cell) {
+        // the type first, the conversions below may change it
+        cell.type = sqlite3_value_type(value);
+        cell.integer = sqlite3_value_int64(value);
+        cell.real = sqlite3_value_double(value);
+
+        // text and blobs may contain 0 bytes, a zero-length blob has no pointer
+        const char* p = (cell.type == SQLITE_BLOB)
+            ? (const char*) sqlite3_value_blob(value)
+            : (const char*) sqlite3_value_text(value);
+        if(p) {
+            cell.text.assign(p, sqlite3_value_bytes(value));
+        } else {
+            cell.text.clear();
+        }
+    }
+
+    void Database::preupdateHook(void* data, sqlite3* handle, int operation,
+            const char* database, const char* table, sqlite3_int64 oldRowid,
+            sqlite3_int64 newRowid) {
+        Database* db = (Database*) data;
+
+        ChangeEvent event;
+        event.operation = toChangeOperation(operation);
+        event.database = database;
+        event.table = table;
+        event.rowid = (operation == SQLITE_DELETE) ? oldRowid : newRowid;
+
+#if SQLITE_VERSION_NUMBER >= 3036000
+        // incremental blob writes are reported as deletes, that have only
+        // old values
+        if(sqlite3_preupdate_blobwrite(handle) >= 0) {
+            event.operation = CHANGE_UPDATE;
+        }
+#endif
+
+        int count = sqlite3_preupdate_count(handle);
+        sqlite3_value* value;
+
+        if(operation != SQLITE_INSERT) {
+            event.oldValues.resize(count);
+            for(int i = 0; i < count; ++i) {
+                if(sqlite3_preupdate_old(handle, i, &value) == SQLITE_OK) {
+                    toValue(value, event.oldValues[i]);
+                }
+            }
+        }
+
+        if(operation != SQLITE_DELETE) {
+            event.newValues.resize(count);
+            for(int i = 0; i < count; ++i) {
+                if(sqlite3_preupdate_new(handle, i, &value) == SQLITE_OK) {
+                    toValue(value, event.newValues[i]);
+                }
+            }
+        }
+
+        db->pendingChanges.push_back(event);
+    }
+#endif
+
+    int Database::commitHook(void* data) {
+        Database* db = (Database*) data;
+
+        if(db->changes) {
+            for(size_t i = 0; i < db->pendingChanges.size(); ++i) {
+                db->changes->publish(db->pendingChanges[i]);
+            }
+        }
+        db->pendingChanges.clear();
+        db->savepoints.clear();
+
+        // 0 lets the commit proceed
+        return 0;
+    }
+
+    void Database::rollbackHook(void* data) {
+        Database* db = (Database*) data;
+
+        // results read inside the transaction might contain rolled back rows
+        if(db->cache) {
+            db->cache->clear();
+        }
+
+        db->pendingChanges.clear();
+        db->savepoints.clear();
+    }
+
+    void Database::enableQueryCache(const size_t budget) {
+        this->checkDatabaseOpened();
+
+        if(this->cache) {
+            this->cache->setBudget(budget);
+            return;
+        }
+
+        this->cache = new QueryCache(this->database, budget);
+        this->installHooks();
+    }
+
+    void Database::disableQueryCache(void) {
+        if(!this->cache) {
+            return;
+        }
+
+        delete this->cache;
+        this->cache = NULL;
+        this->installHooks();
+    }
+
+    void Database::clearQueryCache(void) {
+        if(this->cache) {
+            this->cache->clear();
+        }
+    }
+
+    QueryCacheStats Database::getQueryCacheStats(void) const {
+        if(this->cache) {
+            return this->cache->getStats();
+        }
+
+        return QueryCacheStats();
+    }
+
+    void Database::attachChangeStream(ChangeStream& stream, const bool values) {
+        this->checkDatabaseOpened();
+
+#ifndef SQLITE_ENABLE_PREUPDATE_HOOK
+        if(values) {
+            throw SQLiteException("Capturing values requires SQLITE_ENABLE_PREUPDATE_HOOK.");
+        }
+#endif
+
+        this->pendingChanges.clear();
+        this->savepoints.clear();
+        this->changes = &stream;
+        this->changeValues = values;
+        this->installHooks();
+    }
+
+    void Database::detachChangeStream(void) {
+        if(!this->changes) {
+            return;
+        }
+
+        this->changes = NULL;
+        this->changeValues = false;
+        this->pendingChanges.clear();
+        this->savepoints.clear();
+        this->installHooks();
+    }
+
+    std::chrono::steady_clock::time_point Database::getDeadline(const long timeout) const {
+        long milliseconds = (timeout < 0) ? this->timeout : timeout;
+
+        if(milliseconds == 0) {
+            return std::chrono::steady_clock::time_point::max();
+        }
+        return std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+    }
+
+    void Database::guard(const std::chrono::steady_clock::time_point& deadline, CancellationToken* token) {
+        this->timedOut = false;
+
+        if(deadline == std::chrono::steady_clock::time_point::max() && !token) {
+            return;
+        }
+
+        // installed on first use, so connections without timeouts do not pay for it
+        if(!this->progressInstalled) {
+            sqlite3_progress_handler(this->database, this->progressInterval,
+                    Database::progressHandler, this);
+            this->progressInstalled = true;
+        }
+
+        this->activeDeadline = deadline;
+        this->activeToken = token;
+    }
+
+    int Database::unguard(const int result) {
+        this->activeDeadline = std::chrono::steady_clock::time_point::max();
+        this->activeToken = NULL;
+
+        if(result == SQLITE_INTERRUPT) {
+            if(this->timedOut) {
+                this->timeouts++;
+            } else {
+                this->interrupts++;
+            }
+        }
+
+        return result;
+    }
+
+    int Database::step(sqlite3_stmt* statement, const TableAccess& access, size_t& mark,
+            const std::chrono::steady_clock::time_point& deadline, CancellationToken* token) {
+        if(!sqlite3_stmt_busy(statement)) {
+            mark = this->pendingChanges.size();
+        }
+
+        this->guard(deadline, token);
+        int result = this->unguard(sqlite3_step(statement));
+
+        if(result == SQLITE_DONE) {
+            this->trackSavepoint(access, mark);
+        } else if(result != SQLITE_ROW && !sqlite3_stmt_readonly(statement)) {
+            // sqlite undid the changes of the failed statement, unless it
+            // failed with OR FAIL, that keeps the rows changed before the error
+            if(sqlite3_get_autocommit(this->database) || sqlite3_changes(this->database) == 0) {
+                this->discardChanges(mark);
+            }
+        }
+
+        return result;
+    }
+
+    void Database::discardChanges(const size_t mark) {
+        if(sqlite3_get_autocommit(this->database)) {
+            this->pendingChanges.clear();
+            this->savepoints.clear();
+        } else if(mark < this->pendingChanges.size()) {
+            this->pendingChanges.erase(this->pendingChanges.begin() + mark,
+                    this->pendingChanges.end());
+        }
+    }
+
+    void Database::trackSavepoint(const TableAccess& access, const size_t mark) {
+        if(access.savepointOperation.empty()) {
+            return;
+        }
+
+        if(access.savepointOperation == "BEGIN") {
+            this->savepoints.push_back(std::pair<std::string, size_t>(access.savepoint, mark));
+            return;
+        }
+
+        // the innermost savepoint with the name, names are case insensitive
+        size_t index = this->savepoints.size();
+        while(index > 0 && sqlite3_stricmp(this->savepoints[index - 1].first.c_str(),
+                    access.savepoint.c_str()) != 0) {
+            --index;
+        }
+
+        if(index == 0) {
+            return;
+        }
+
+        if(access.savepointOperation == "ROLLBACK") {
+            // the savepoint stays open after ROLLBACK TO
+            this->discardChanges(this->savepoints[index - 1].second);
+            this->savepoints.erase(this->savepoints.begin() + index, this->savepoints.end());
+        } else {
+            this->savepoints.erase(this->savepoints.begin() + index - 1, this->savepoints.end());
+        }
+    }
+
+    void Database::throwInterrupted(void) {
+        // an interrupt may roll back the whole transaction
+        if(sqlite3_get_autocommit(this->database)) {
+            this->transaction = false;
+        }
+
+        if(this->timedOut) {
+            throw QueryTimeout();
+        }
+        throw QueryInterrupted();
+    }
+
+    int Database::progressHandler(void* data) {
+        Database* db = (Database*) data;
+
+        if(db->activeToken && db->activeToken->isCancelled()) {
+            return 1;
+        }
+
+        if(db->activeDeadline != std::chrono::steady_clock::time_point::max()
+                && std::chrono::steady_clock::now() >= db->activeDeadline) {
+            db->timedOut = true;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    void Database::setTimeout(const long milliseconds) {
+        this->timeout = milliseconds;
+    }
+
+    void Database::setCancellationToken(CancellationToken* token) {
+        this->token = token;
+    }
+
+    void Database::setProgressInterval(const int instructions) {
+        this->progressInterval = instructions;
+
+        if(this->progressInstalled) {
+            sqlite3_progress_handler(this->database, this->progressInterval,
+                    Database::progressHandler, this);
+        }
+    }
+
+    void Database::interrupt(void) {
+        this->checkDatabaseOpened();
+
+        sqlite3_interrupt(this->database);
+    }
+
+    CancellationStats Database::getCancellationStats(void) const {
+        CancellationStats stats;
+        stats.timeouts = this->timeouts.load();
+        stats.interrupts = this->interrupts.load();
+        return stats;
+    }
+
+    void Database::enablePlanAnalysis(const PlanCallback& callback) {
+        this->checkDatabaseOpened();
+
+        delete this->plans;
+        this->plans = new PlanRegistry(callback);
+    }
+
+    void Database::disablePlanAnalysis(void) {
+        delete this->plans;
+        this->plans = NULL;
+    }
+
+    std::vector<QueryProfile> Database::getQueryProfiles(void) const {
+        if(this->plans) {
+            return this->plans->getProfiles();
+        }
+
+        return std::vector<QueryProfile>();
+    }
+}
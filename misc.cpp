@@ -27,6 +27,12 @@ namespace sqlitepp {
         return std::string(stream.str());
     }
 
+    std::string longToString(const long long value) {
+        std::stringstream stream;
+        stream << value;
+        return std::string(stream.str());
+    }
+
     std::string floatToString(const float value) {
         std::stringstream stream;
         stream << value;
@@ -0,0 +1,293 @@
+/* Copyright (C)
+ * 2012 - Paul Weingardt
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include "sqlitepp.h"
+
+#include <cctype>
+
+namespace sqlitepp {
+
+    /**
+     * @brief sqlite table names are case insensitive
+     */
+    static std::string normalizeTable(const char* name) {
+        std::string table(name ? name : "");
+        for(size_t i = 0; i < table.size(); ++i) {
+            table[i] = tolower((unsigned char) table[i]);
+        }
+        return table;
+    }
+
+    /**
+     * @brief functions whose results differ from call to call
+     */
+    static bool isVolatileFunction(const char* name) {
+        static const char* functions[] = {
+            "random", "randomblob", "changes", "total_changes",
+            "last_insert_rowid", "date", "time", "datetime", "julianday",
+            "strftime", "unixepoch", "current_date", "current_time",
+            "current_timestamp", NULL
+        };
+
+        if(!name) {
+            return false;
+        }
+
+        for(int i = 0; functions[i]; ++i) {
+            if(sqlite3_stricmp(name, functions[i]) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    double QueryCacheStats::hitRate(void) const {
+        if(this->hits + this->misses == 0) {
+            return 0.0;
+        }
+        return (double) this->hits / (double) (this->hits + this->misses);
+    }
+
+    QueryCache::QueryCache(sqlite3* db, const size_t budget) {
+        this->dataVersion = NULL;
+        this->budget = budget;
+        this->memory = 0;
+        this->hits = this->misses = this->evictions = this->invalidations = 0;
+        this->epoch = 0;
+
+        if(sqlite3_prepare_v2(db, "PRAGMA data_version;", -1, &this->dataVersion, NULL) != SQLITE_OK) {
+            throw SQLiteException(db);
+        }
+
+        this->lastDataVersion = -1;
+        this->checkDataVersion();
+    }
+
+    QueryCache::~QueryCache(void) {
+        sqlite3_finalize(this->dataVersion);
+    }
+
+    void QueryCache::checkDataVersion(void) {
+        int version = this->lastDataVersion;
+        if(sqlite3_step(this->dataVersion) == SQLITE_ROW) {
+            version = sqlite3_column_int(this->dataVersion, 0);
+        }
+        sqlite3_reset(this->dataVersion);
+
+        if(version != this->lastDataVersion) {
+            this->invalidations += this->entries.size();
+            this->clear();
+            this->lastDataVersion = version;
+        }
+    }
+
+    std::shared_ptr<const ResultSet> QueryCache::lookup(const std::string& key) {
+        this->checkDataVersion();
+
+        std::map<std::string, EntryIterator>::iterator it = this->entries.find(key);
+        if(it == this->entries.end()) {
+            this->misses++;
+            return std::shared_ptr<const ResultSet>();
+        }
+
+        this->hits++;
+        this->lru.splice(this->lru.begin(), this->lru, it->second);
+        return it->second->result;
+    }
+
+    void QueryCache::insert(const std::string& key, const std::shared_ptr<const ResultSet>& result,
+            const std::set<std::string>& tables, const unsigned long epoch) {
+        if(epoch != this->epoch || tables.empty()) {
+            return;
+        }
+
+        size_t size = result->size() + key.capacity() + sizeof(Entry);
+        if(size > this->budget) {
+            return;
+        }
+
+        std::map<std::string, EntryIterator>::iterator existing = this->entries.find(key);
+        if(existing != this->entries.end()) {
+            this->erase(existing->second);
+        }
+
+        Entry entry;
+        entry.key = key;
+        entry.result = result;
+        entry.tables = tables;
+        entry.size = size;
+
+        this->lru.push_front(entry);
+        this->entries[key] = this->lru.begin();
+        for(std::set<std::string>::const_iterator table = tables.begin();
+                table != tables.end(); ++table) {
+            this->tables[*table].insert(key);
+        }
+        this->memory += size;
+
+        this->evict();
+    }
+
+    void QueryCache::erase(EntryIterator entry) {
+        for(std::set<std::string>::const_iterator table = entry->tables.begin();
+                table != entry->tables.end(); ++table) {
+            std::map<std::string, std::set<std::string> >::iterator keys = this->tables.find(*table);
+            if(keys != this->tables.end()) {
+                keys->second.erase(entry->key);
+                if(keys->second.empty()) {
+                    this->tables.erase(keys);
+                }
+            }
+        }
+
+        this->memory -= entry->size;
+        this->entries.erase(entry->key);
+        this->lru.erase(entry);
+    }
+
+    void QueryCache::evict(void) {
+        while(this->memory > this->budget && !this->lru.empty()) {
+            EntryIterator last = this->lru.end();
+            --last;
+            this->erase(last);
+            this->evictions++;
+        }
+    }
+
+    void QueryCache::invalidate(const std::string& table) {
+        this->epoch++;
+
+        std::map<std::string, std::set<std::string> >::iterator keys =
+            this->tables.find(normalizeTable(table.c_str()));
+        if(keys == this->tables.end()) {
+            return;
+        }
+
+        // erase() modifies the key set, so work on a copy
+        std::set<std::string> affected(keys->second);
+        for(std::set<std::string>::const_iterator key = affected.begin();
+                key != affected.end(); ++key) {
+            std::map<std::string, EntryIterator>::iterator entry = this->entries.find(*key);
+            if(entry != this->entries.end()) {
+                this->erase(entry->second);
+                this->invalidations++;
+            }
+        }
+    }
+
+    void QueryCache::invalidate(const TableAccess& access) {
+        // ROLLBACK TO may undo changes to any table of the transaction
+        if(access.schema || access.savepointOperation == "ROLLBACK") {
+            this->invalidations += this->entries.size();
+            this->clear();
+            return;
+        }
+
+        for(std::set<std::string>::const_iterator table = access.writes.begin();
+                table != access.writes.end(); ++table) {
+            this->invalidate(*table);
+        }
+    }
+
+    void QueryCache::clear(void) {
+        this->epoch++;
+        this->lru.clear();
+        this->entries.clear();
+        this->tables.clear();
+        this->memory = 0;
+    }
+
+    void QueryCache::setBudget(const size_t budget) {
+        this->budget = budget;
+        this->evict();
+    }
+
+    size_t QueryCache::getBudget(void) const {
+        return this->budget;
+    }
+
+    unsigned long QueryCache::getEpoch(void) const {
+        return this->epoch;
+    }
+
+    QueryCacheStats QueryCache::getStats(void) const {
+        QueryCacheStats stats;
+        stats.hits = this->hits;
+        stats.misses = this->misses;
+        stats.evictions = this->evictions;
+        stats.invalidations = this->invalidations;
+        stats.entries = this->entries.size();
+        stats.memory = this->memory;
+        stats.budget = this->budget;
+        return stats;
+    }
+
+    int QueryCache::authorizer(void* data, int action, const char* arg1,
+            const char* arg2, const char*, const char*) {
+        TableAccess* access = (TableAccess*) data;
+
+        switch(action) {
+            case SQLITE_READ:
+                access->reads.insert(normalizeTable(arg1));
+                break;
+
+            case SQLITE_INSERT:
+            case SQLITE_UPDATE:
+            case SQLITE_DELETE:
+                access->writes.insert(normalizeTable(arg1));
+                break;
+
+            case SQLITE_FUNCTION:
+                if(isVolatileFunction(arg2)) {
+                    access->deterministic = false;
+                }
+                break;
+
+            case SQLITE_SAVEPOINT:
+                access->savepointOperation = arg1;
+                access->savepoint = arg2;
+                break;
+
+            case SQLITE_CREATE_INDEX:
+            case SQLITE_CREATE_TABLE:
+            case SQLITE_CREATE_TEMP_INDEX:
+            case SQLITE_CREATE_TEMP_TABLE:
+            case SQLITE_CREATE_TEMP_TRIGGER:
+            case SQLITE_CREATE_TEMP_VIEW:
+            case SQLITE_CREATE_TRIGGER:
+            case SQLITE_CREATE_VIEW:
+            case SQLITE_DROP_INDEX:
+            case SQLITE_DROP_TABLE:
+            case SQLITE_DROP_TEMP_INDEX:
+            case SQLITE_DROP_TEMP_TABLE:
+            case SQLITE_DROP_TEMP_TRIGGER:
+            case SQLITE_DROP_TEMP_VIEW:
+            case SQLITE_DROP_TRIGGER:
+            case SQLITE_DROP_VIEW:
+            case SQLITE_ALTER_TABLE:
+            case SQLITE_ATTACH:
+            case SQLITE_DETACH:
+            case SQLITE_CREATE_VTABLE:
+            case SQLITE_DROP_VTABLE:
+                access->schema = true;
+                break;
+        }
+
+        return SQLITE_OK;
+    }
+}
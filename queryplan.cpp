@@ -0,0 +1,130 @@
+/* Copyright (C)
+ * 2012 - Paul Weingardt
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include "sqlitepp.h"
+
+namespace sqlitepp {
+
+    bool QueryPlan::hasProblems(void) const {
+        return !this->fullScans.empty() || this->tempBTree || this->automaticIndex;
+    }
+
+    /**
+     * @brief sets the flags of the plan for a single node
+     */
+    static void classify(QueryPlan& plan, const std::string& detail) {
+        // "SCAN t" or "SCAN TABLE t" in older versions, index scans mention their index
+        if(detail.compare(0, 5, "SCAN ") == 0
+                && detail.find("INDEX") == std::string::npos
+                && detail.find("CONSTANT ROW") == std::string::npos
+                && detail.find("SUBQUERY") == std::string::npos
+                && detail.find("(subquery") == std::string::npos) {
+            plan.fullScans.push_back(detail);
+        }
+
+        if(detail.find("USE TEMP B-TREE") != std::string::npos) {
+            plan.tempBTree = true;
+        }
+
+        if(detail.find("AUTOMATIC") != std::string::npos) {
+            plan.automaticIndex = true;
+        }
+    }
+
+    PlanRegistry::PlanRegistry(const PlanCallback& callback) : callback(callback) {
+    }
+
+    QueryPlan PlanRegistry::explain(sqlite3* db, const std::string& sql) {
+        QueryPlan plan;
+        plan.sql = sql;
+
+        std::string explain = "EXPLAIN QUERY PLAN " + sql;
+        sqlite3_stmt* statement = NULL;
+        if(sqlite3_prepare_v2(db, explain.c_str(), explain.size(), &statement, NULL) != SQLITE_OK) {
+            sqlite3_finalize(statement);
+            return plan;
+        }
+
+        std::map<int, size_t> indices;
+        while(sqlite3_step(statement) == SQLITE_ROW) {
+            PlanNode node;
+            node.id = sqlite3_column_int(statement, 0);
+            node.parent = sqlite3_column_int(statement, 1);
+
+            const char* p = (const char*) sqlite3_column_text(statement, 3);
+            if(p) {
+                node.detail = p;
+            }
+
+            indices[node.id] = plan.nodes.size();
+            classify(plan, node.detail);
+            plan.nodes.push_back(node);
+        }
+        sqlite3_finalize(statement);
+
+        for(size_t i = 0; i < plan.nodes.size(); ++i) {
+            std::map<int, size_t>::const_iterator parent = indices.find(plan.nodes[i].parent);
+            if(plan.nodes[i].parent != 0 && parent != indices.end()) {
+                plan.nodes[parent->second].children.push_back(i);
+            }
+        }
+
+        return plan;
+    }
+
+    void PlanRegistry::analyze(sqlite3* db, const std::string& sql) {
+        if(this->profiles.find(sql) != this->profiles.end()) {
+            return;
+        }
+
+        std::shared_ptr<QueryPlan> plan(new QueryPlan(PlanRegistry::explain(db, sql)));
+
+        QueryProfile profile;
+        profile.plan = plan;
+        profile.runs = profile.fullScanSteps = profile.sorts = profile.automaticIndexRows = 0;
+        this->profiles[sql] = profile;
+
+        if(this->callback && plan->hasProblems()) {
+            this->callback(*plan);
+        }
+    }
+
+    void PlanRegistry::record(const std::string& sql, sqlite3_stmt* statement, const bool completed) {
+        std::map<std::string, QueryProfile>::iterator profile = this->profiles.find(sql);
+        if(profile == this->profiles.end()) {
+            return;
+        }
+
+        profile->second.fullScanSteps += sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+        profile->second.sorts += sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_SORT, 1);
+        profile->second.automaticIndexRows += sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+
+        if(completed) {
+            profile->second.runs++;
+        }
+    }
+
+    std::vector<QueryProfile> PlanRegistry::getProfiles(void) const {
+        std::vector<QueryProfile> result;
+        for(std::map<std::string, QueryProfile>::const_iterator profile = this->profiles.begin();
+                profile != this->profiles.end(); ++profile) {
+            result.push_back(profile->second);
+        }
+        return result;
+    }
+}
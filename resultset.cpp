@@ -0,0 +1,242 @@
+/* Copyright (C)
+ * 2012 - Paul Weingardt
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include "sqlitepp.h"
+
+#include <stdlib.h>
+
+namespace sqlitepp {
+
+    ResultSet::ResultSet(void) {
+        this->rows = 0;
+    }
+
+    void ResultSet::setColumns(sqlite3_stmt* statement) {
+        if(this->columns) {
+            return;
+        }
+
+        std::shared_ptr<std::vector<std::string> > names(new std::vector<std::string>());
+        for(int index = 0; index < sqlite3_column_count(statement); ++index) {
+            names->push_back(sqlite3_column_name(statement, index));
+        }
+        this->columns = names;
+    }
+
+    void ResultSet::append(sqlite3_stmt* statement) {
+        int count = sqlite3_column_count(statement);
+
+        this->setColumns(statement);
+
+        for(int index = 0; index < count; ++index) {
+            Cell cell;
+            cell.integer = 0;
+            cell.size = 0;
+            cell.type = sqlite3_column_type(statement, index);
+
+            const char* p = NULL;
+            switch(cell.type) {
+                case SQLITE_INTEGER:
+                    cell.integer = sqlite3_column_int64(statement, index);
+                    break;
+
+                case SQLITE_FLOAT:
+                    cell.real = sqlite3_column_double(statement, index);
+                    break;
+
+                case SQLITE_TEXT:
+                    p = (const char*) sqlite3_column_text(statement, index);
+                    cell.size = sqlite3_column_bytes(statement, index);
+                    break;
+
+                case SQLITE_BLOB:
+                    p = (const char*) sqlite3_column_blob(statement, index);
+                    cell.size = sqlite3_column_bytes(statement, index);
+                    break;
+            }
+
+            if(cell.type == SQLITE_TEXT || cell.type == SQLITE_BLOB) {
+                cell.offset = this->arena.size();
+                if(p) {
+                    this->arena.insert(this->arena.end(), p, p + cell.size);
+                } else {
+                    cell.size = 0;
+                }
+            }
+
+            this->cells.push_back(cell);
+        }
+
+        this->rows++;
+    }
+
+    void ResultSet::append(const ResultSet& other, const size_t row) {
+        if(!this->columns) {
+            this->columns = other.columns;
+        }
+
+        for(int index = 0; index < other.getColumnCount(); ++index) {
+            Cell cell = other.getCell(row, index);
+
+            if(cell.type == SQLITE_TEXT || cell.type == SQLITE_BLOB) {
+                const char* p = &other.arena[0] + cell.offset;
+                cell.offset = this->arena.size();
+                this->arena.insert(this->arena.end(), p, p + cell.size);
+            }
+
+            this->cells.push_back(cell);
+        }
+
+        this->rows++;
+    }
+
+    const ResultSet::Cell& ResultSet::getCell(const size_t row, const int column) const {
+        if(row >= this->rows || column < 0 || column >= this->getColumnCount()) {
+            throw SQLiteException("Index out of range.");
+        }
+
+        return this->cells[row * this->columns->size() + column];
+    }
+
+    size_t ResultSet::getRowCount(void) const {
+        return this->rows;
+    }
+
+    int ResultSet::getColumnCount(void) const {
+        return this->columns ? this->columns->size() : 0;
+    }
+
+    const std::string& ResultSet::getColumnName(const int column) const {
+        if(column < 0 || column >= this->getColumnCount()) {
+            throw SQLiteException("Index out of range.");
+        }
+
+        return (*this->columns)[column];
+    }
+
+    int ResultSet::getColumnIndex(const std::string& name) const {
+        for(int index = 0; index < this->getColumnCount(); ++index) {
+            if((*this->columns)[index] == name) {
+                return index;
+            }
+        }
+        return -1;
+    }
+
+    int ResultSet::getType(const size_t row, const int column) const {
+        return this->getCell(row, column).type;
+    }
+
+    bool ResultSet::isNull(const size_t row, const int column) const {
+        return this->getCell(row, column).type == SQLITE_NULL;
+    }
+
+    int ResultSet::getInt(const size_t row, const int column) const {
+        return (int) this->getInt64(row, column);
+    }
+
+    sqlite3_int64 ResultSet::getInt64(const size_t row, const int column) const {
+        const Cell& cell = this->getCell(row, column);
+
+        switch(cell.type) {
+            case SQLITE_INTEGER:
+                return cell.integer;
+
+            case SQLITE_FLOAT:
+                return (sqlite3_int64) cell.real;
+
+            case SQLITE_TEXT:
+            case SQLITE_BLOB:
+                return strtoll(this->getString(row, column).c_str(), NULL, 10);
+
+            default:
+                return 0;
+        }
+    }
+
+    double ResultSet::getDouble(const size_t row, const int column) const {
+        const Cell& cell = this->getCell(row, column);
+
+        switch(cell.type) {
+            case SQLITE_INTEGER:
+                return (double) cell.integer;
+
+            case SQLITE_FLOAT:
+                return cell.real;
+
+            case SQLITE_TEXT:
+            case SQLITE_BLOB:
+                return strtod(this->getString(row, column).c_str(), NULL);
+
+            default:
+                return 0.0;
+        }
+    }
+
+    std::string ResultSet::getString(const size_t row, const int column) const {
+        const Cell& cell = this->getCell(row, column);
+
+        switch(cell.type) {
+            case SQLITE_INTEGER:
+                return longToString(cell.integer);
+
+            case SQLITE_FLOAT: {
+                // the same format sqlite uses to convert doubles into text
+                char buffer[32];
+                sqlite3_snprintf(sizeof(buffer), buffer, "%!.15g", cell.real);
+                return std::string(buffer);
+            }
+
+            case SQLITE_TEXT:
+            case SQLITE_BLOB:
+                return std::string(cell.size ? &this->arena[cell.offset] : "", cell.size);
+
+            default:
+                return "NULL";
+        }
+    }
+
+    const void* ResultSet::getBlob(const size_t row, const int column, int& size) const {
+        const Cell& cell = this->getCell(row, column);
+
+        if(cell.type != SQLITE_TEXT && cell.type != SQLITE_BLOB) {
+            size = 0;
+            return NULL;
+        }
+
+        size = cell.size;
+        return cell.size ? &this->arena[cell.offset] : "";
+    }
+
+    size_t ResultSet::size(void) const {
+        size_t bytes = sizeof(ResultSet) + this->cells.capacity() * sizeof(Cell)
+            + this->arena.capacity();
+
+        for(int index = 0; index < this->getColumnCount(); ++index) {
+            bytes += sizeof(std::string) + (*this->columns)[index].capacity();
+        }
+        return bytes;
+    }
+
+    void ResultSet::clear(void) {
+        this->columns.reset();
+        this->cells.clear();
+        this->arena.clear();
+        this->rows = 0;
+    }
+}
@@ -0,0 +1,234 @@
+/* Copyright (C)
+ * 2012 - Paul Weingardt
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include "sqlitepp.h"
+
+#include <chrono>
+
+namespace sqlitepp {
+
+    Script::Script(Database& database) : db(database) {
+        if(!db.isOpen()) {
+            throw DatabaseNotOpened;
+        }
+
+        this->tail = 0;
+    }
+
+    Script::~Script(void) {
+        this->finalize();
+    }
+
+    void Script::prepare(const std::string& str) {
+        this->finalize();
+        this->sql = str;
+
+        while(this->tail < this->sql.size()) {
+            if(this->prepareNext() == SQLITE_OK) {
+                continue;
+            }
+
+            // statements, that may depend on a preceding schema change, are
+            // prepared by exec()
+            for(size_t i = 0; i < this->accesses.size(); ++i) {
+                if(this->accesses[i].schema) {
+                    return;
+                }
+            }
+
+            SQLiteException error(this->db.database);
+            this->finalize();
+            throw error;
+        }
+    }
+
+    int Script::prepareNext(void) {
+        const char* start = this->sql.c_str() + this->tail;
+        const char* next = NULL;
+        sqlite3_stmt* statement = NULL;
+        TableAccess access;
+
+        int result = this->db.prepare(start, this->sql.size() - this->tail, &statement, &next,
+                access);
+
+        if(result != SQLITE_OK) {
+            return result;
+        }
+
+        this->tail = next ? next - this->sql.c_str() : this->sql.size();
+
+        // statement is NULL for whitespace and comments
+        if(statement) {
+            this->statements.push_back(statement);
+            this->accesses.push_back(access);
+
+            ScriptStatementStats stats;
+            stats.sql = sqlite3_sql(statement);
+            stats.sql.erase(0, stats.sql.find_first_not_of(" \t\r\n"));
+            stats.changes = 0;
+            stats.seconds = 0.0;
+            this->stats.push_back(stats);
+
+            for(std::map<std::string, Value>::const_iterator parameter = this->parameters.begin();
+                    parameter != this->parameters.end(); ++parameter) {
+                this->bind(statement, parameter->first, parameter->second);
+            }
+        }
+
+        return SQLITE_OK;
+    }
+
+    void Script::bind(sqlite3_stmt* statement, const std::string& name, const Value& value) {
+        int index = sqlite3_bind_parameter_index(statement, name.c_str());
+        if(index == 0) {
+            return;
+        }
+
+        int result = SQLITE_OK;
+        switch(value.type) {
+            case SQLITE_INTEGER:
+                result = sqlite3_bind_int64(statement, index, value.integer);
+                break;
+
+            case SQLITE_FLOAT:
+                result = sqlite3_bind_double(statement, index, value.real);
+                break;
+
+            case SQLITE_TEXT:
+                result = sqlite3_bind_text(statement, index, value.text.c_str(), value.text.size(),
+                        SQLITE_TRANSIENT);
+                break;
+
+            default:
+                result = sqlite3_bind_null(statement, index);
+                break;
+        }
+
+        if(result != SQLITE_OK) {
+            throw SQLiteException(this->db.database);
+        }
+    }
+
+    void Script::bind(const std::string& name, const Value& value) {
+        this->parameters[name] = value;
+
+        for(size_t i = 0; i < this->statements.size(); ++i) {
+            this->bind(this->statements[i], name, value);
+        }
+    }
+
+    void Script::bindString(const std::string& name, const std::string& value) {
+        Value cell;
+        cell.type = SQLITE_TEXT;
+        cell.text = value;
+        this->bind(name, cell);
+    }
+
+    void Script::bindInt(const std::string& name, const int value) {
+        Value cell;
+        cell.type = SQLITE_INTEGER;
+        cell.integer = value;
+        this->bind(name, cell);
+    }
+
+    void Script::bindDouble(const std::string& name, const double value) {
+        Value cell;
+        cell.type = SQLITE_FLOAT;
+        cell.real = value;
+        this->bind(name, cell);
+    }
+
+    void Script::bindNull(const std::string& name) {
+        Value cell;
+        cell.type = SQLITE_NULL;
+        this->bind(name, cell);
+    }
+
+    int Script::exec(void) {
+        int total = 0;
+        std::chrono::steady_clock::time_point deadline = this->db.getDeadline(-1);
+
+        for(size_t i = 0; ; ++i) {
+            if(i == this->statements.size()) {
+                if(this->tail >= this->sql.size()) {
+                    break;
+                }
+
+                if(this->prepareNext() != SQLITE_OK) {
+                    throw SQLiteException(this->db.database);
+                }
+
+                if(i == this->statements.size()) {
+                    // only whitespace or comments were left
+                    break;
+                }
+            }
+
+            sqlite3_stmt* statement = this->statements[i];
+            int before = sqlite3_total_changes(this->db.database);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            int result;
+            size_t mark = 0;
+            while((result = this->db.step(statement, this->accesses[i], mark, deadline,
+                            this->db.token)) == SQLITE_ROW) {
+            }
+
+            this->stats[i].seconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+
+            if(this->db.cache) {
+                this->db.cache->invalidate(this->accesses[i]);
+            }
+
+            if(result != SQLITE_DONE) {
+                SQLiteException error(this->db.database);
+                sqlite3_reset(statement);
+
+                if(result == SQLITE_INTERRUPT) {
+                    this->db.throwInterrupted();
+                }
+                throw error;
+            }
+
+            sqlite3_reset(statement);
+
+            this->stats[i].changes = sqlite3_total_changes(this->db.database) - before;
+            total += this->stats[i].changes;
+        }
+
+        return total;
+    }
+
+    const std::vector<ScriptStatementStats>& Script::getStats(void) const {
+        return this->stats;
+    }
+
+    void Script::finalize(void) {
+        for(size_t i = 0; i < this->statements.size(); ++i) {
+            sqlite3_finalize(this->statements[i]);
+        }
+
+        this->statements.clear();
+        this->stats.clear();
+        this->parameters.clear();
+        this->accesses.clear();
+        this->sql.clear();
+        this->tail = 0;
+    }
+}
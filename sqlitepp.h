@@ -22,8 +22,26 @@
 #include <sqlite3.h>
 #include <time.h>
 #include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <istream>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <streambuf>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#if __cplusplus >= 201703L
+#include <optional>
+#endif
 
 namespace sqlitepp {
 
@@ -43,7 +61,13 @@ namespace sqlitepp {
      */
     std::string intToString(const int value);
 
+    /**
+     * @brief converts a 64 bit integer into a string
+     */
+    std::string longToString(const long long value);
+
     class Statement;
+    class QueryCache;
 
     /**
      * @brief used for transactions
@@ -66,339 +90,2128 @@ namespace sqlitepp {
      */
     enum OpenFlags {READONLY, READWRITE, CREATE};
 
+    /**
+     * @brief Indicates, who owns the memory of bound text and blobs.
+     *
+     * COPY = sqlite copies the value (SQLITE_TRANSIENT)
+     * REFERENCE = sqlite uses the memory directly (SQLITE_STATIC). It must
+     * stay valid until the parameter is rebound or the statement is finalized.
+     */
+    enum Ownership {COPY, REFERENCE};
+
+    /**
+     * @brief a blob parameter for Statement::bind()
+     */
+    struct Blob {
+        const void* data;
+        int size;
+        Ownership ownership;
+
+        Blob(const void* data, const int size, const Ownership ownership = COPY)
+            : data(data), size(size), ownership(ownership) {
+        }
+    };
 
     /**
-     * @brief The main database class
+     * @brief a blob parameter of the passed size filled with zeros, for
+     * Statement::bind(). Reserves space, that is written with a BlobHandle later.
      */
-    class Database {
+    struct ZeroBlob {
+        int size;
+
+        ZeroBlob(const int size) : size(size) {
+        }
+    };
+
+    /**
+     * @brief a text parameter for Statement::bind(), that is not copied by default
+     */
+    struct Text {
+        const char* data;
+        int size;
+        Ownership ownership;
+
+        Text(const std::string& value, const Ownership ownership = REFERENCE)
+            : data(value.c_str()), size(value.size()), ownership(ownership) {
+        }
+
+        /**
+         * @brief a temporary does not outlive the binding, use bindString() instead
+         */
+        Text(std::string&& value, const Ownership ownership = REFERENCE) = delete;
+    };
+
+    template<size_t N, typename Tuple>
+    struct TupleBinder;
+
+    /**
+     * @brief a single sqlite value
+     *
+     * All representations are taken from sqlite, so reading any of them
+     * gives the same result as the matching sqlite3_value_* function.
+     * text holds the bytes of blobs.
+     */
+    struct Value {
+        int type;
+        sqlite3_int64 integer;
+        double real;
+        std::string text;
+    };
+
+    /**
+     * @brief An owning, materialized result of a query
+     *
+     * Cells are stored row after row in a compact array, text and blob
+     * bytes in a single arena. The column names are shared between copies.
+     * A ResultSet does not refer to its statement or database, so it can be
+     * moved to and read from other threads.
+     */
+    class ResultSet {
         friend class Statement;
         private:
-            /**
-             * @brief initializes all fields
-             */
-            void init(void);
+            struct Cell {
+                union {
+                    sqlite3_int64 integer;
+                    double real;
+
+                    /**
+                     * @brief the offset of text and blobs in the arena
+                     */
+                    size_t offset;
+                };
+                int size;
+                int type;
+            };
 
             /**
-             * @brief indicates, if a database has been opened
+             * @brief the column names in selection order
              */
-            bool isopen;
+            std::shared_ptr<const std::vector<std::string> > columns;
 
             /**
-             * @brief indicates, if there is an active transaction
+             * @brief the cells, row after row
              */
-            bool transaction;
+            std::vector<Cell> cells;
 
             /**
-             * @brief the sqlite3* pointer
+             * @brief the bytes of all text and blob values
              */
-            sqlite3* database;
+            std::vector<char> arena;
 
-            /**
-             * @brief the last result from sqlite3
-             */
-            int lastResult;
+            size_t rows;
 
-            inline void checkDatabaseOpened() const;
-        public:
             /**
-             * @brief empty constructor. Does not open a database
+             * @brief takes the column names from the statement, if there are
+             * none yet. Also works before the first step.
              */
-            Database(void);
+            void setColumns(sqlite3_stmt* statement);
 
             /**
-             * @brief Opens a sqlite3 database with the passed flag
-             *
-             * @param path
-             * @param flag
+             * @brief appends the current row of the statement
              */
-            Database(const std::string& path, const OpenFlags flag = CREATE);
+            void append(sqlite3_stmt* statement);
 
             /**
-             * @brief destructor
+             * @brief appends a row of another result set with the same columns
              */
-            ~Database(void);
+            void append(const ResultSet& other, const size_t row);
 
             /**
-             * @brief Opens a database with the passed flag
-             *
-             * @param path
-             * @param flag
+             * @brief gets a cell, throws an exception if out of range
              */
-            void open(const std::string& path, const OpenFlags flag = CREATE);
+            const Cell& getCell(const size_t row, const int column) const;
 
+        public:
             /**
-             * @brief returns true, when a database has been opened, false otherwise
+             * @brief creates an empty result set
              */
-            bool isOpen(void);
+            ResultSet(void);
 
-            /**
-             * @brief closes the database
-             */
-            void close(void);
+            size_t getRowCount(void) const;
 
-            /**
-             * @brief activates foreign keys
-             */
-            void activateForeignKeys(void);
+            int getColumnCount(void) const;
+
+            const std::string& getColumnName(const int column) const;
 
             /**
-             * @brief deactivates foreign keys
+             * @brief gets the index of a column, -1 if there is no such column
              */
-            void deactivateForeignKeys(void);
+            int getColumnIndex(const std::string& name) const;
 
             /**
-             * @brief executes a single statement without return values
-             *
-             * @param sql SQL statement
+             * @brief gets the sqlite type of a cell, e.g. SQLITE_INTEGER
              */
-            int exec(const std::string& sql);
+            int getType(const size_t row, const int column) const;
+
+            bool isNull(const size_t row, const int column) const;
+
+            int getInt(const size_t row, const int column) const;
+
+            sqlite3_int64 getInt64(const size_t row, const int column) const;
+
+            double getDouble(const size_t row, const int column) const;
 
             /**
-             * @brief Begins a transaction
+             * @brief gets a cell as string, "NULL" for null values like
+             * Statement::getString()
              */
-            void beginTransaction(const TransactionFlags = DEFERRED);
+            std::string getString(const size_t row, const int column) const;
 
             /**
-             * @brief commits a transaction
+             * @brief gets a text or blob cell without copying
+             *
+             * @param row
+             * @param column
+             * @param size the size in bytes
+             *
+             * @return a pointer into the result set, NULL for other types
              */
-            void endTransaction(void);
+            const void* getBlob(const size_t row, const int column, int& size) const;
 
             /**
-             * @brief executes a rollback on the current transaction
+             * @brief the approximate number of bytes used by this result set
              */
-            void rollback(void);
+            size_t size(void) const;
 
             /**
-             * @brief gets the last ID, that has been inserted
-             *
-             * @return
+             * @brief removes all rows and columns
              */
-            int getLastRowId(void);
+            void clear(void);
+    };
+
+    /**
+     * @brief the tables a statement reads and writes, collected by
+     * the sqlite authorizer while the statement is being prepared
+     */
+    struct TableAccess {
+        std::set<std::string> reads;
+        std::set<std::string> writes;
+
+        /**
+         * @brief true, if the statement changes the schema
+         */
+        bool schema;
+
+        /**
+         * @brief false, if the statement calls a function like random()
+         * whose result differs from call to call
+         */
+        bool deterministic;
+
+        /**
+         * @brief "BEGIN", "RELEASE" or "ROLLBACK", if the statement is a
+         * SAVEPOINT, RELEASE or ROLLBACK TO statement
+         */
+        std::string savepointOperation;
+
+        /**
+         * @brief name of the savepoint the statement refers to
+         */
+        std::string savepoint;
+
+        TableAccess(void) : schema(false), deterministic(true) {
+        }
     };
 
+    /**
+     * @brief statistics of the query cache
+     */
+    struct QueryCacheStats {
+        unsigned long hits;
+        unsigned long misses;
+        unsigned long evictions;
+        unsigned long invalidations;
+        size_t entries;
+        size_t memory;
+        size_t budget;
+
+        /**
+         * @brief hits / (hits + misses), 0 if there were no lookups
+         */
+        double hitRate(void) const;
+    };
 
     /**
-     * @brief A prepared statement
+     * @brief LRU cache of materialized query results
+     *
+     * Entries are keyed by the SQL text and the bound parameter values.
+     * An entry is dropped as soon as one of the tables it was read from
+     * changes on this connection (sqlite3_update_hook) or another
+     * connection commits to the database (PRAGMA data_version).
      */
-    class Statement {
+    class QueryCache {
         private:
-            /**
-             * @brief the last result returned by sqlite
-             */
-            int lastResult;
+            struct Entry {
+                std::string key;
+                std::shared_ptr<const ResultSet> result;
+                std::set<std::string> tables;
+                size_t size;
+            };
 
-            /**
-             * @brief true if the statement has been finalized, false otherwise.
-             *
-             * also used to indicate, whether a statement has been prepared:
-             * prepared = !finalized
-             */
-            bool finalized;
+            typedef std::list<Entry>::iterator EntryIterator;
 
             /**
-             * @brief the sqlite3 statement
+             * @brief the entries, most recently used first
              */
-            sqlite3_stmt* statement;
+            std::list<Entry> lru;
 
             /**
-             * @brief the database reference
+             * @brief the entries by key
              */
-            Database& db;
+            std::map<std::string, EntryIterator> entries;
 
             /**
-             * @brief the columns, that has been selected, and their indices
+             * @brief the keys of the entries that read from a table
              */
-            std::map<std::string, int> columns;
+            std::map<std::string, std::set<std::string> > tables;
 
             /**
-             * @brief performs a single step
+             * @brief the prepared PRAGMA data_version statement
              */
-            StepValue step(void);
+            sqlite3_stmt* dataVersion;
 
             /**
-             * @brief checks, if a statement has been prepared. Throws an exception, if not.
+             * @brief the data version seen by the last lookup
              */
-            inline void checkPrepared() const;
+            int lastDataVersion;
 
-        public:
-            /**
-             * @brief Default constructor
-             *
-             * @param db database, on which the statement is executed
-             */
-            Statement(Database& db);
+            size_t budget;
+            size_t memory;
+            unsigned long hits;
+            unsigned long misses;
+            unsigned long evictions;
+            unsigned long invalidations;
 
             /**
-             * @brief Destructor
+             * @brief incremented on every change, see getEpoch()
              */
-            ~Statement();
+            unsigned long epoch;
 
             /**
-             * @brief Binds the nth parameter with the passed value as string
-             *
-             * @param n
-             * @param value
+             * @brief clears the cache, if another connection changed the database
              */
-            void bindString(const int n, const std::string& value);
+            void checkDataVersion(void);
 
-            /**
-             * @brief Binds the nth parameter with the passed value as integer
-             *
-             * @param n
-             * @param value
-             */
-            void bindInt(const int n, const int value);
+            void erase(EntryIterator entry);
 
+            void evict(void);
+
+        public:
             /**
-             * @brief Binds the nth parameter with the passed value as integer
+             * @brief creates an empty cache for the passed connection
              *
-             * @param n
-             * @param value
+             * @param db the connection
+             * @param budget the maximum number of bytes used by the entries
              */
-            void bindDouble(const int n, const double value);
+            QueryCache(sqlite3* db, const size_t budget);
 
-             /**
-             * @brief Binds the nth parameter with the null value
-             *
-             * @param n
-             */
-            void bindNull(const int n);
+            ~QueryCache(void);
 
             /**
-             * @brief gets a column as string
-             *
-             * @param column
+             * @brief looks up a result and marks it as most recently used
              *
-             * @return
+             * @return the result or an empty pointer on a miss
              */
-            std::string getString(const std::string& column) const;
+            std::shared_ptr<const ResultSet> lookup(const std::string& key);
 
             /**
-             * @brief gets a column as integer
+             * @brief stores a result
              *
-             * @param column
+             * The result is dropped, if the cache has been changed since the
+             * passed epoch, because the result might be outdated already.
              *
-             * @return
+             * @param key SQL text and parameters
+             * @param result the materialized result
+             * @param tables the tables the result has been read from
+             * @param epoch the epoch at the start of the query
              */
-            int getInt(const std::string& column) const;
+            void insert(const std::string& key, const std::shared_ptr<const ResultSet>& result,
+                    const std::set<std::string>& tables, const unsigned long epoch);
 
             /**
-             * @brief gets a column as double
-             *
-             * @param column
-             *
-             * @return
+             * @brief drops all entries that read from the passed table
              */
-            double getDouble(const std::string& column) const;
+            void invalidate(const std::string& table);
 
             /**
-             * @brief gets the nth column as string and saves it in out
-             *
-             * @param n the index
-             * @param out the output string
+             * @brief drops all entries affected by the passed table access
              */
-            void getString(const int n, std::string& out) const;
+            void invalidate(const TableAccess& access);
 
             /**
-             * @brief gets the nth column as integer and saves it in out
-             *
-             * @param n the index
-             * @param out the output integer
+             * @brief drops all entries
              */
-            void getInt(const int n, int& out) const;
+            void clear(void);
 
             /**
-             * @brief gets the nth column as string and saves it in out
-             *
-             * @param n the index
-             * @param out the output double
+             * @brief sets the memory budget and evicts entries if necessary
              */
-            void getDouble(const int n, double& out) const;
+            void setBudget(const size_t budget);
 
-            /**
-             * @brief gets the nth column as string
-             *
-             * @param n
-             */
-            std::string getString(const int n) const ;
+            size_t getBudget(void) const;
 
             /**
-             * @brief gets the nth column as integer
-             *
-             * @param n
+             * @brief gets the current epoch. The epoch changes whenever a table
+             * is changed.
              */
-            int getInt(const int n) const;
+            unsigned long getEpoch(void) const;
 
-            /**
-             * @brief gets the nth column as double
-             *
-             * @param n
-             */
-            double getDouble(const int n) const;
+            QueryCacheStats getStats(void) const;
 
             /**
-             * @brief prepares a string as statement
-             *
-             * @param sql SQL statement
+             * @brief sqlite authorizer, that collects the accessed tables into
+             * the TableAccess passed as user data. Allows everything.
              */
-            void prepare(const std::string& sql);
+            static int authorizer(void* data, int action, const char* arg1,
+                    const char* arg2, const char* database, const char* trigger);
+    };
 
-            /**
-             * @brief fetches the next row
-             *
-             * @return
-             */
-            bool fetchRow(void);
 
-            /**
-             * @brief executes the prepared statement
-             */
-            void exec(void);
+    /**
+     * @brief a row of EXPLAIN QUERY PLAN
+     */
+    struct PlanNode {
+        int id;
+
+        /**
+         * @brief the id of the parent node, 0 for top level nodes
+         */
+        int parent;
+
+        /**
+         * @brief the description, e.g. SEARCH users USING INDEX users_name (name=?)
+         */
+        std::string detail;
+
+        /**
+         * @brief the indices of the child nodes in QueryPlan::nodes
+         */
+        std::vector<size_t> children;
+    };
 
-            /**
-             * @brief releases any allocated resources. Use it, when you want to
-             * reuse a statement object.
-             */
-            void finalize(void);
+    /**
+     * @brief the parsed query plan of a statement
+     */
+    struct QueryPlan {
+        std::string sql;
+
+        /**
+         * @brief the nodes in the order returned by sqlite
+         */
+        std::vector<PlanNode> nodes;
+
+        /**
+         * @brief the details of the nodes, that scan a whole table without index
+         */
+        std::vector<std::string> fullScans;
+
+        /**
+         * @brief true, if a temporary b-tree is used, e.g. for ORDER BY or GROUP BY
+         */
+        bool tempBTree;
+
+        /**
+         * @brief true, if sqlite builds an automatic index for the query
+         */
+        bool automaticIndex;
+
+        QueryPlan(void) : tempBTree(false), automaticIndex(false) {
+        }
+
+        /**
+         * @brief true, if there is a full scan, temporary b-tree or automatic index
+         */
+        bool hasProblems(void) const;
+    };
+
+    /**
+     * @brief the plan and the runtime counters of a SQL text
+     */
+    struct QueryProfile {
+        std::shared_ptr<const QueryPlan> plan;
+
+        /**
+         * @brief the number of completed executions
+         */
+        unsigned long runs;
+
+        /**
+         * @brief the number of steps in full table scans (SQLITE_STMTSTATUS_FULLSCAN_STEP)
+         */
+        unsigned long fullScanSteps;
+
+        /**
+         * @brief the number of sort operations (SQLITE_STMTSTATUS_SORT)
+         */
+        unsigned long sorts;
+
+        /**
+         * @brief the number of rows inserted into automatic indices
+         * (SQLITE_STMTSTATUS_AUTOINDEX)
+         */
+        unsigned long automaticIndexRows;
     };
 
+    /**
+     * @brief called, when a newly analyzed plan has problems
+     */
+    typedef std::function<void(const QueryPlan& plan)> PlanCallback;
 
-    class SQLiteException : public std::exception {
+    /**
+     * @brief Captures the query plans of prepared statements
+     *
+     * Each SQL text is analyzed with EXPLAIN QUERY PLAN once, when it is
+     * prepared the first time. The runtime counters of the statements are
+     * added up per SQL text.
+     */
+    class PlanRegistry {
         private:
-            std::string error;
+            std::map<std::string, QueryProfile> profiles;
+
+            PlanCallback callback;
 
         public:
+            PlanRegistry(const PlanCallback& callback);
+
             /**
-             * @brief Constructs a SQLiteException with the passed error message
+             * @brief analyzes the plan of the SQL text, unless it is known already
              */
-            SQLiteException(const std::string& str) {
-                this->error = str;
-            }
+            void analyze(sqlite3* db, const std::string& sql);
 
             /**
-             * @brief The error message is the last sqlite error in the
-             * passed sqlite database.
+             * @brief adds and resets the runtime counters of a statement
              *
-             * @param db
+             * @param sql the SQL text of the statement
+             * @param statement
+             * @param completed true, if the statement has run to completion
              */
-            SQLiteException(sqlite3* db) {
-                this->error = std::string(sqlite3_errmsg(db));
-            }
+            void record(const std::string& sql, sqlite3_stmt* statement, const bool completed);
 
-            virtual ~SQLiteException() throw() {
-            }
+            std::vector<QueryProfile> getProfiles(void) const;
 
             /**
-             * @brief gets the error message
+             * @brief runs EXPLAIN QUERY PLAN and parses the result
              */
-            virtual const char* what() const throw() {
+            static QueryPlan explain(sqlite3* db, const std::string& sql);
+    };
+
+    /**
+     * @brief the kind of change of a ChangeEvent
+     */
+    enum ChangeOperation {CHANGE_INSERT, CHANGE_UPDATE, CHANGE_DELETE};
+
+    /**
+     * @brief a committed row level change
+     */
+    struct ChangeEvent {
+        ChangeOperation operation;
+
+        /**
+         * @brief the schema name, e.g. main or temp
+         */
+        std::string database;
+
+        std::string table;
+
+        /**
+         * @brief the rowid of the row. For updates, that change the rowid, this
+         * is the new rowid.
+         */
+        sqlite3_int64 rowid;
+
+        /**
+         * @brief the values before the change, empty for inserts or if values
+         * are not captured
+         */
+        std::vector<Value> oldValues;
+
+        /**
+         * @brief the values after the change, empty for deletes, for
+         * incremental blob writes or if values are not captured
+         */
+        std::vector<Value> newValues;
+    };
+
+    /**
+     * @brief bounded lock-free multi-producer multi-consumer queue
+     *
+     * Each slot carries a sequence number, that tells producers and
+     * consumers whether the slot is free or filled for the current lap.
+     * The capacity is rounded up to a power of two.
+     */
+    template<typename T>
+    class RingBuffer {
+        private:
+            struct Slot {
+                std::atomic<size_t> sequence;
+                T data;
+            };
+
+            Slot* slots;
+
+            size_t mask;
+
+            // keep producers and consumers off each other's cache line
+            alignas(64) std::atomic<size_t> head;
+            alignas(64) std::atomic<size_t> tail;
+
+            RingBuffer(const RingBuffer&);
+            RingBuffer& operator=(const RingBuffer&);
+
+        public:
+            RingBuffer(const size_t capacity) {
+                size_t size = 2;
+                while(size < capacity) {
+                    size <<= 1;
+                }
+
+                this->slots = new Slot[size];
+                this->mask = size - 1;
+                for(size_t i = 0; i < size; ++i) {
+                    this->slots[i].sequence.store(i, std::memory_order_relaxed);
+                }
+                this->head.store(0, std::memory_order_relaxed);
+                this->tail.store(0, std::memory_order_relaxed);
+            }
+
+            ~RingBuffer(void) {
+                delete[] this->slots;
+            }
+
+            size_t capacity(void) const {
+                return this->mask + 1;
+            }
+
+            /**
+             * @brief moves the value into the buffer
+             *
+             * @return false, if the buffer is full. The value is left untouched.
+             */
+            bool push(T& value) {
+                Slot* slot;
+                size_t pos = this->tail.load(std::memory_order_relaxed);
+
+                for(;;) {
+                    slot = &this->slots[pos & this->mask];
+                    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+                    long diff = (long) sequence - (long) pos;
+
+                    if(diff == 0) {
+                        if(this->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                            break;
+                        }
+                    } else if(diff < 0) {
+                        return false;
+                    } else {
+                        pos = this->tail.load(std::memory_order_relaxed);
+                    }
+                }
+
+                slot->data = std::move(value);
+                slot->sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+
+            /**
+             * @brief moves the oldest value out of the buffer
+             *
+             * @return false, if the buffer is empty
+             */
+            bool pop(T& value) {
+                Slot* slot;
+                size_t pos = this->head.load(std::memory_order_relaxed);
+
+                for(;;) {
+                    slot = &this->slots[pos & this->mask];
+                    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+                    long diff = (long) sequence - (long) (pos + 1);
+
+                    if(diff == 0) {
+                        if(this->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                            break;
+                        }
+                    } else if(diff < 0) {
+                        return false;
+                    } else {
+                        pos = this->head.load(std::memory_order_relaxed);
+                    }
+                }
+
+                value = std::move(slot->data);
+                slot->sequence.store(pos + this->mask + 1, std::memory_order_release);
+                return true;
+            }
+    };
+
+    /**
+     * @brief a stream of committed changes
+     *
+     * Databases attached with Database::attachChangeStream() publish their
+     * changes when a transaction commits. Changes of rolled back
+     * transactions are never published. Any number of connections can
+     * publish into the same stream, any number of threads can drain it.
+     *
+     * If the stream is full, new events are dropped and counted instead of
+     * blocking the writing connection.
+     */
+    class ChangeStream {
+        private:
+            RingBuffer<ChangeEvent> buffer;
+
+            std::atomic<unsigned long> published;
+            std::atomic<unsigned long> dropped;
+
+        public:
+            /**
+             * @brief creates an empty stream
+             *
+             * @param capacity the number of events, rounded up to a power of two
+             */
+            ChangeStream(const size_t capacity = 4096);
+
+            /**
+             * @brief publishes an event, drops it if the stream is full
+             *
+             * @return false, if the event has been dropped
+             */
+            bool publish(ChangeEvent& event);
+
+            /**
+             * @brief moves the available events to the end of the passed vector
+             *
+             * @param events the output vector
+             * @param max the maximum number of events, 0 for all
+             *
+             * @return the number of events
+             */
+            size_t drain(std::vector<ChangeEvent>& events, const size_t max = 0);
+
+            /**
+             * @brief gets the number of published events
+             */
+            unsigned long getPublished(void) const;
+
+            /**
+             * @brief gets the number of events dropped because the stream was full
+             */
+            unsigned long getDropped(void) const;
+    };
+
+    /**
+     * @brief cancels queries from any thread
+     *
+     * A token can be passed to a Statement or a Database. The running query
+     * is stopped within the progress handler interval after cancel() and
+     * fails with QueryInterrupted.
+     */
+    class CancellationToken {
+        private:
+            std::atomic<bool> cancelled;
+
+        public:
+            CancellationToken(void) : cancelled(false) {
+            }
+
+            void cancel(void) {
+                this->cancelled.store(true, std::memory_order_relaxed);
+            }
+
+            bool isCancelled(void) const {
+                return this->cancelled.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * @brief makes the token usable for the next query
+             */
+            void reset(void) {
+                this->cancelled.store(false, std::memory_order_relaxed);
+            }
+    };
+
+    /**
+     * @brief counters of stopped queries
+     */
+    struct CancellationStats {
+        /**
+         * @brief queries stopped because their deadline passed
+         */
+        unsigned long timeouts;
+
+        /**
+         * @brief queries stopped by a CancellationToken or Database::interrupt()
+         */
+        unsigned long interrupts;
+    };
+
+    /**
+     * @brief The main database class
+     */
+    class Database {
+        friend class Statement;
+        friend class Script;
+        friend class CheckpointManager;
+        friend class BlobHandle;
+        private:
+            /**
+             * @brief initializes all fields
+             */
+            void init(void);
+
+            /**
+             * @brief indicates, if a database has been opened
+             */
+            bool isopen;
+
+            /**
+             * @brief indicates, if there is an active transaction
+             */
+            bool transaction;
+
+            /**
+             * @brief the sqlite3* pointer
+             */
+            sqlite3* database;
+
+            /**
+             * @brief the last result from sqlite3
+             */
+            int lastResult;
+
+            /**
+             * @brief the query cache, NULL if disabled
+             */
+            QueryCache* cache;
+
+            /**
+             * @brief the plan registry, NULL if plan analysis is disabled
+             */
+            PlanRegistry* plans;
+
+            /**
+             * @brief the attached change stream, NULL if none
+             */
+            ChangeStream* changes;
+
+            /**
+             * @brief true, if old and new values are captured for the change stream
+             */
+            bool changeValues;
+
+            /**
+             * @brief the changes of the current transaction, published on commit
+             */
+            std::vector<ChangeEvent> pendingChanges;
+
+            /**
+             * @brief the open savepoints with the number of pending changes
+             * at the time they were created
+             */
+            std::vector<std::pair<std::string, size_t> > savepoints;
+
+            /**
+             * @brief the default timeout of queries in milliseconds, 0 for none
+             */
+            long timeout;
+
+            /**
+             * @brief the default cancellation token of queries, may be NULL
+             */
+            CancellationToken* token;
+
+            /**
+             * @brief the number of virtual machine instructions between two
+             * calls of the progress handler
+             */
+            int progressInterval;
+
+            bool progressInstalled;
+
+            /**
+             * @brief true, if the authorizer has been installed on the connection
+             */
+            bool authorizerInstalled;
+
+            /**
+             * @brief the TableAccess the authorizer collects into, while a
+             * statement is prepared through prepare(). NULL otherwise.
+             */
+            TableAccess* accessTarget;
+
+            /**
+             * @brief the deadline of the currently running step
+             */
+            std::chrono::steady_clock::time_point activeDeadline;
+
+            /**
+             * @brief the cancellation token of the currently running step
+             */
+            CancellationToken* activeToken;
+
+            /**
+             * @brief true, if the progress handler stopped the last step because
+             * of its deadline
+             */
+            bool timedOut;
+
+            std::atomic<unsigned long> timeouts;
+            std::atomic<unsigned long> interrupts;
+
+            inline void checkDatabaseOpened() const;
+
+            /**
+             * @brief computes the deadline of a query, that starts now
+             *
+             * @param timeout in milliseconds, 0 for none, negative for the default
+             */
+            std::chrono::steady_clock::time_point getDeadline(const long timeout) const;
+
+            /**
+             * @brief makes the progress handler watch the deadline and token
+             */
+            void guard(const std::chrono::steady_clock::time_point& deadline, CancellationToken* token);
+
+            /**
+             * @brief stops watching and counts interrupted steps
+             *
+             * @return result
+             */
+            int unguard(const int result);
+
+            /**
+             * @brief steps a statement, stopped by the passed deadline and token
+             *
+             * Drops the pending changes of the statement, if it fails, and
+             * keeps track of the savepoints.
+             *
+             * @param access the tables accessed by the statement
+             * @param mark the number of pending changes when the statement
+             * started, set by the first step
+             */
+            int step(sqlite3_stmt* statement, const TableAccess& access, size_t& mark,
+                    const std::chrono::steady_clock::time_point& deadline, CancellationToken* token);
+
+            /**
+             * @brief drops the pending changes after mark, or all of them, if
+             * the transaction has been rolled back
+             */
+            void discardChanges(const size_t mark);
+
+            /**
+             * @brief updates the savepoints after a SAVEPOINT, RELEASE or
+             * ROLLBACK TO statement
+             *
+             * @param mark the number of pending changes when the statement started
+             */
+            void trackSavepoint(const TableAccess& access, const size_t mark);
+
+            /**
+             * @brief throws QueryTimeout or QueryInterrupted for the last step,
+             * that returned SQLITE_INTERRUPT
+             *
+             * Resets the transaction flag, if sqlite rolled back the transaction.
+             */
+            void throwInterrupted(void);
+
+            static int progressHandler(void* data);
+
+            /**
+             * @brief installs or removes the sqlite hooks, depending on whether
+             * the query cache or a change stream is active
+             *
+             * The authorizer is installed once for the lifetime of the
+             * connection, since installing it expires all prepared statements.
+             */
+            void installHooks(void);
+
+            /**
+             * @brief prepares a statement and collects the tables it accesses
+             */
+            int prepare(const char* sql, const int bytes, sqlite3_stmt** statement,
+                    const char** tail, TableAccess& access);
+
+            /**
+             * @brief forwards to QueryCache::authorizer while a statement is
+             * prepared through prepare(), allows everything
+             */
+            static int authorizer(void* data, int action, const char* arg1,
+                    const char* arg2, const char* database, const char* trigger);
+
+            static void updateHook(void* data, int operation, const char* database,
+                    const char* table, sqlite3_int64 rowid);
+
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+            static void preupdateHook(void* data, sqlite3* db, int operation,
+                    const char* database, const char* table, sqlite3_int64 oldRowid,
+                    sqlite3_int64 newRowid);
+#endif
+
+            static int commitHook(void* data);
+
+            static void rollbackHook(void* data);
+        public:
+            /**
+             * @brief empty constructor. Does not open a database
+             */
+            Database(void);
+
+            /**
+             * @brief Opens a sqlite3 database with the passed flag
+             *
+             * @param path
+             * @param flag
+             */
+            Database(const std::string& path, const OpenFlags flag = CREATE);
+
+            /**
+             * @brief destructor
+             */
+            ~Database(void);
+
+            /**
+             * @brief Opens a database with the passed flag
+             *
+             * @param path
+             * @param flag
+             */
+            void open(const std::string& path, const OpenFlags flag = CREATE);
+
+            /**
+             * @brief returns true, when a database has been opened, false otherwise
+             */
+            bool isOpen(void);
+
+            /**
+             * @brief closes the database
+             */
+            void close(void);
+
+            /**
+             * @brief activates foreign keys
+             */
+            void activateForeignKeys(void);
+
+            /**
+             * @brief deactivates foreign keys
+             */
+            void deactivateForeignKeys(void);
+
+            /**
+             * @brief executes a single statement without return values
+             *
+             * @param sql SQL statement
+             */
+            int exec(const std::string& sql);
+
+            /**
+             * @brief Begins a transaction
+             */
+            void beginTransaction(const TransactionFlags = DEFERRED);
+
+            /**
+             * @brief commits a transaction
+             */
+            void endTransaction(void);
+
+            /**
+             * @brief executes a rollback on the current transaction
+             */
+            void rollback(void);
+
+            /**
+             * @brief gets the last ID, that has been inserted
+             *
+             * @return
+             */
+            int getLastRowId(void);
+
+            /**
+             * @brief enables the query result cache
+             *
+             * Results of read-only statements are cached by SQL text and bound
+             * parameters once they have been fetched completely. Only
+             * deterministic queries should be run while the cache is enabled.
+             * Calling it again changes the budget. Closing the database
+             * disables the cache.
+             *
+             * @param budget the maximum number of bytes used by cached results
+             */
+            void enableQueryCache(const size_t budget = 4 * 1024 * 1024);
+
+            /**
+             * @brief disables the query cache and drops all entries
+             */
+            void disableQueryCache(void);
+
+            /**
+             * @brief drops all cached results
+             */
+            void clearQueryCache(void);
+
+            /**
+             * @brief gets the statistics of the query cache. All values are 0,
+             * if the cache is disabled.
+             */
+            QueryCacheStats getQueryCacheStats(void) const;
+
+            /**
+             * @brief publishes all committed changes of this connection into
+             * the passed stream, until it is detached or the database is closed
+             *
+             * Changes are collected per transaction and published on commit.
+             * Changes undone by a failed statement or by ROLLBACK TO a
+             * savepoint are dropped.
+             *
+             * @param stream the stream, must outlive the attachment
+             * @param values capture old and new values of the changed rows. This
+             * requires a sqlite library and a build with SQLITE_ENABLE_PREUPDATE_HOOK
+             * (cmake -DSQLITEPP_PREUPDATE_HOOK=1), otherwise an exception is thrown.
+             */
+            void attachChangeStream(ChangeStream& stream, const bool values = false);
+
+            /**
+             * @brief stops publishing changes. Changes of an open transaction
+             * are discarded.
+             */
+            void detachChangeStream(void);
+
+            /**
+             * @brief sets the default timeout of queries on this connection.
+             * Queries, that run longer, fail with QueryTimeout.
+             *
+             * @param milliseconds the timeout, 0 for none
+             */
+            void setTimeout(const long milliseconds);
+
+            /**
+             * @brief sets the default cancellation token of queries on this connection
+             *
+             * @param token the token, NULL for none
+             */
+            void setCancellationToken(CancellationToken* token);
+
+            /**
+             * @brief sets how often timeouts and tokens are checked
+             *
+             * @param instructions the number of virtual machine instructions
+             * between two checks
+             */
+            void setProgressInterval(const int instructions);
+
+            /**
+             * @brief stops all running queries of this connection. Can be
+             * called from any thread while the database is open.
+             */
+            void interrupt(void);
+
+            /**
+             * @brief gets the number of queries stopped by timeouts and interrupts
+             */
+            CancellationStats getCancellationStats(void) const;
+
+            /**
+             * @brief enables the analysis of query plans
+             *
+             * Every SQL text prepared by a Statement is analyzed once with
+             * EXPLAIN QUERY PLAN. Meant for debugging and tests, e.g. to catch
+             * queries, that have lost their index. Closing the database
+             * disables the analysis.
+             *
+             * @param callback called for new plans with full scans, temporary
+             * b-trees or automatic indices
+             */
+            void enablePlanAnalysis(const PlanCallback& callback = PlanCallback());
+
+            /**
+             * @brief disables the analysis of query plans and drops all profiles
+             */
+            void disablePlanAnalysis(void);
+
+            /**
+             * @brief gets the plans and runtime counters of all analyzed SQL
+             * texts. Empty, if the analysis is disabled.
+             */
+            std::vector<QueryProfile> getQueryProfiles(void) const;
+    };
+
+
+    /**
+     * @brief A prepared statement
+     */
+    class Statement {
+        private:
+            /**
+             * @brief the last result returned by sqlite
+             */
+            int lastResult;
+
+            /**
+             * @brief true if the statement has been finalized, false otherwise.
+             *
+             * also used to indicate, whether a statement has been prepared:
+             * prepared = !finalized
+             */
+            bool finalized;
+
+            /**
+             * @brief the sqlite3 statement
+             */
+            sqlite3_stmt* statement;
+
+            /**
+             * @brief the database reference
+             */
+            Database& db;
+
+            /**
+             * @brief the columns, that has been selected, and their indices
+             */
+            std::map<std::string, int> columns;
+
+            /**
+             * @brief the prepared SQL text
+             */
+            std::string sql;
+
+            /**
+             * @brief the bound parameters, serialized for the cache key
+             */
+            std::vector<std::string> parameters;
+
+            /**
+             * @brief the tables accessed by the statement
+             */
+            TableAccess access;
+
+            /**
+             * @brief the number of pending changes of the database, when the
+             * running query started
+             */
+            size_t changeMark;
+
+            /**
+             * @brief true, if results of this statement may be cached
+             */
+            bool cacheable;
+
+            /**
+             * @brief true, between the first fetched row and the end of the results
+             */
+            bool running;
+
+            /**
+             * @brief the cached result the rows are served from, if any
+             */
+            std::shared_ptr<const ResultSet> cached;
+
+            /**
+             * @brief the current row in the cached result
+             */
+            size_t cachedRow;
+
+            /**
+             * @brief the result being materialized for the cache
+             */
+            std::shared_ptr<ResultSet> pending;
+
+            /**
+             * @brief the cache epoch when the pending result was started
+             */
+            unsigned long pendingEpoch;
+
+            /**
+             * @brief performs a single step
+             */
+            StepValue step(void);
+
+            /**
+             * @brief looks up the current query in the cache. On a miss, a
+             * new pending result is started.
+             *
+             * @return true, if the rows are served from the cache
+             */
+            bool lookupCache(void);
+
+            /**
+             * @brief appends the current row to the pending result
+             */
+            void materializeRow(void);
+
+            /**
+             * @brief gets the SQL text and the bound parameters as cache key
+             */
+            std::string getCacheKey(void) const;
+
+            /**
+             * @brief records a bound parameter for the cache key
+             */
+            void setParameter(const int n, const std::string& value);
+
+            /**
+             * @brief the indices of the named parameters, resolved once when
+             * the statement is prepared. Names are stored with and without
+             * their prefix.
+             */
+            std::map<std::string, int> parameterIndices;
+
+            /**
+             * @brief the timeout in milliseconds, negative for the default of the database
+             */
+            long timeout;
+
+            /**
+             * @brief the cancellation token, NULL for the token of the database
+             */
+            CancellationToken* token;
+
+            /**
+             * @brief the deadline of the running query
+             */
+            std::chrono::steady_clock::time_point deadline;
+
+            /**
+             * @brief checks, if a statement has been prepared. Throws an exception, if not.
+             */
+            inline void checkPrepared() const;
+
+            void bindFrom(const int) {
+            }
+
+            template<typename T, typename... Args>
+            void bindFrom(const int n, const T& value, const Args&... values) {
+                this->bind(n, value);
+                this->bindFrom(n + 1, values...);
+            }
+
+        public:
+            /**
+             * @brief Default constructor
+             *
+             * @param db database, on which the statement is executed
+             */
+            Statement(Database& db);
+
+            /**
+             * @brief Destructor
+             */
+            ~Statement();
+
+            /**
+             * @brief sets the timeout of the queries of this statement. Queries,
+             * that run longer, fail with QueryTimeout.
+             *
+             * @param milliseconds the timeout, 0 for none, negative for the
+             * timeout of the database
+             */
+            void setTimeout(const long milliseconds);
+
+            /**
+             * @brief sets the cancellation token of this statement
+             *
+             * @param token the token, NULL for the token of the database
+             */
+            void setCancellationToken(CancellationToken* token);
+
+            /**
+             * @brief gets the index of a named parameter
+             *
+             * @param name the name with prefix (:name, @name, $name) or without
+             *
+             * @return the index, throws an exception for unknown names
+             */
+            int getParameterIndex(const std::string& name) const;
+
+            /**
+             * @brief Binds the nth parameter with the passed value as string
+             *
+             * @param n
+             * @param value
+             * @param ownership REFERENCE, if value outlives the binding
+             */
+            void bindString(const int n, const std::string& value, const Ownership ownership = COPY);
+
+            /**
+             * @brief Binds the nth parameter with the passed value as integer
+             *
+             * @param n
+             * @param value
+             */
+            void bindInt(const int n, const int value);
+
+            /**
+             * @brief Binds the nth parameter with the passed value as 64 bit integer
+             *
+             * @param n
+             * @param value
+             */
+            void bindInt64(const int n, const sqlite3_int64 value);
+
+            /**
+             * @brief Binds the nth parameter with the passed value as blob
+             *
+             * @param n
+             * @param data
+             * @param size the size in bytes. A size of 0 binds an empty blob,
+             * also if data is NULL.
+             * @param ownership REFERENCE, if data outlives the binding
+             */
+            void bindBlob(const int n, const void* data, const int size, const Ownership ownership = COPY);
+
+            /**
+             * @brief Binds the nth parameter with the passed value as integer
+             *
+             * @param n
+             * @param value
+             */
+            void bindDouble(const int n, const double value);
+
+             /**
+             * @brief Binds the nth parameter with the null value
+             *
+             * @param n
+             */
+            void bindNull(const int n);
+
+            void bindString(const std::string& name, const std::string& value, const Ownership ownership = COPY);
+
+            void bindInt(const std::string& name, const int value);
+
+            void bindInt64(const std::string& name, const sqlite3_int64 value);
+
+            void bindDouble(const std::string& name, const double value);
+
+            void bindBlob(const std::string& name, const void* data, const int size,
+                    const Ownership ownership = COPY);
+
+            void bindNull(const std::string& name);
+
+            /**
+             * @brief Binds the nth parameter, the sqlite type is chosen by the
+             * C++ type at compile time. Integers up to 32 bit are bound with
+             * sqlite3_bind_int, larger ones with sqlite3_bind_int64.
+             */
+            template<typename T>
+            typename std::enable_if<std::is_integral<T>::value>::type
+            bind(const int n, const T value) {
+                if(sizeof(T) < sizeof(int) || (sizeof(T) == sizeof(int) && std::is_signed<T>::value)) {
+                    this->bindInt(n, (int) value);
+                } else {
+                    this->bindInt64(n, (sqlite3_int64) value);
+                }
+            }
+
+            template<typename T>
+            typename std::enable_if<std::is_floating_point<T>::value>::type
+            bind(const int n, const T value) {
+                this->bindDouble(n, value);
+            }
+
+            void bind(const int n, const std::string& value);
+
+            void bind(const int n, const char* value);
+
+            void bind(const int n, const Text& value);
+
+            void bind(const int n, const Blob& value);
+
+            void bind(const int n, const std::vector<unsigned char>& value);
+
+            void bind(const int n, std::nullptr_t);
+
+            void bind(const int n, const ZeroBlob& value);
+
+#if __cplusplus >= 201703L
+            /**
+             * @brief Binds the nth parameter with the contained value or null
+             */
+            template<typename T>
+            void bind(const int n, const std::optional<T>& value) {
+                if(value) {
+                    this->bind(n, *value);
+                } else {
+                    this->bindNull(n);
+                }
+            }
+#endif
+
+            /**
+             * @brief Binds the named parameter, see bind(const int, T)
+             */
+            template<typename T>
+            void bind(const std::string& name, const T& value) {
+                this->bind(this->getParameterIndex(name), value);
+            }
+
+            /**
+             * @brief Binds all values to the parameters 1 to n in one call
+             *
+             * For example: st.bindAll(42, "name", 1.5, nullptr);
+             */
+            template<typename... Args>
+            void bindAll(const Args&... values) {
+                this->bindFrom(1, values...);
+            }
+
+            /**
+             * @brief Binds the elements of a tuple to the parameters 1 to n
+             *
+             * Structs can be bound with std::tie(row.id, row.name).
+             */
+            template<typename... Args>
+            void bindTuple(const std::tuple<Args...>& values) {
+                TupleBinder<sizeof...(Args), std::tuple<Args...> >::bind(*this, values);
+            }
+
+            /**
+             * @brief gets a column as string
+             *
+             * @param column
+             *
+             * @return
+             */
+            std::string getString(const std::string& column) const;
+
+            /**
+             * @brief gets a column as integer
+             *
+             * @param column
+             *
+             * @return
+             */
+            int getInt(const std::string& column) const;
+
+            /**
+             * @brief gets a column as double
+             *
+             * @param column
+             *
+             * @return
+             */
+            double getDouble(const std::string& column) const;
+
+            /**
+             * @brief gets the nth column as string and saves it in out
+             *
+             * @param n the index
+             * @param out the output string
+             */
+            void getString(const int n, std::string& out) const;
+
+            /**
+             * @brief gets the nth column as integer and saves it in out
+             *
+             * @param n the index
+             * @param out the output integer
+             */
+            void getInt(const int n, int& out) const;
+
+            /**
+             * @brief gets the nth column as string and saves it in out
+             *
+             * @param n the index
+             * @param out the output double
+             */
+            void getDouble(const int n, double& out) const;
+
+            /**
+             * @brief gets the nth column as string
+             *
+             * @param n
+             */
+            std::string getString(const int n) const ;
+
+            /**
+             * @brief gets the nth column as integer
+             *
+             * @param n
+             */
+            int getInt(const int n) const;
+
+            /**
+             * @brief gets the nth column as double
+             *
+             * @param n
+             */
+            double getDouble(const int n) const;
+
+            /**
+             * @brief gets the nth column as blob without copying it
+             *
+             * @param n
+             * @param size the size in bytes
+             *
+             * @return the data, valid until the next row is fetched
+             */
+            const void* getBlob(const int n, int& size) const;
+
+            /**
+             * @brief gets a column as blob without copying it
+             *
+             * @param column
+             * @param size the size in bytes
+             *
+             * @return the data, valid until the next row is fetched. Throws an
+             * exception for an unknown column.
+             */
+            const void* getBlob(const std::string& column, int& size) const;
+
+            /**
+             * @brief prepares a string as statement
+             *
+             * @param sql SQL statement
+             */
+            void prepare(const std::string& sql);
+
+            /**
+             * @brief fetches the next row
+             *
+             * @return
+             */
+            bool fetchRow(void);
+
+            /**
+             * @brief fetches all remaining rows
+             *
+             * @param result the output result set, it is cleared first
+             */
+            void fetchAll(ResultSet& result);
+
+            /**
+             * @brief executes the prepared statement
+             */
+            void exec(void);
+
+            /**
+             * @brief releases any allocated resources. Use it, when you want to
+             * reuse a statement object.
+             */
+            void finalize(void);
+    };
+
+    /**
+     * @brief binds the first N elements of a tuple, used by Statement::bindTuple()
+     */
+    template<size_t N, typename Tuple>
+    struct TupleBinder {
+        static void bind(Statement& statement, const Tuple& values) {
+            TupleBinder<N - 1, Tuple>::bind(statement, values);
+            statement.bind(N, std::get<N - 1>(values));
+        }
+    };
+
+    template<typename Tuple>
+    struct TupleBinder<0, Tuple> {
+        static void bind(Statement&, const Tuple&) {
+        }
+    };
+
+    /**
+     * @brief timing and changes of a single statement of a Script
+     */
+    struct ScriptStatementStats {
+        /**
+         * @brief the SQL text of the statement
+         */
+        std::string sql;
+
+        /**
+         * @brief the rows changed by the last execution, including changes
+         * made by triggers
+         */
+        int changes;
+
+        /**
+         * @brief the duration of the last execution in seconds
+         */
+        double seconds;
+    };
+
+    /**
+     * @brief A prepared script of several statements
+     *
+     * The SQL text is split into statements once. Executing the script
+     * again reuses the prepared statements instead of parsing the text
+     * again, as Database::exec() does.
+     *
+     * Statements after a schema change, that cannot be prepared before the
+     * preceding statements have run (e.g. an INSERT into a table created by
+     * the script), are prepared during the first execution. Rows returned
+     * by statements are discarded.
+     */
+    class Script {
+        private:
+            Database& db;
+
+            /**
+             * @brief the SQL text of the script
+             */
+            std::string sql;
+
+            /**
+             * @brief the offset of the text, that has not been prepared yet
+             */
+            size_t tail;
+
+            std::vector<sqlite3_stmt*> statements;
+
+            std::vector<ScriptStatementStats> stats;
+
+            /**
+             * @brief the tables accessed by each statement
+             */
+            std::vector<TableAccess> accesses;
+
+            /**
+             * @brief the bound named parameters, applied to statements
+             * prepared later as well
+             */
+            std::map<std::string, Value> parameters;
+
+            /**
+             * @brief prepares the next statement from the tail
+             *
+             * @return SQLITE_OK, also if only whitespace or comments are left
+             */
+            int prepareNext(void);
+
+            void bind(sqlite3_stmt* statement, const std::string& name, const Value& value);
+
+            void bind(const std::string& name, const Value& value);
+
+            Script(const Script&);
+            Script& operator=(const Script&);
+
+        public:
+            /**
+             * @brief Default constructor
+             *
+             * @param db database, on which the script is executed
+             */
+            Script(Database& db);
+
+            /**
+             * @brief Destructor
+             */
+            ~Script(void);
+
+            /**
+             * @brief splits the SQL text into statements and prepares them
+             *
+             * Throws an exception, if a statement cannot be prepared and no
+             * preceding statement changes the schema.
+             *
+             * @param sql SQL statements separated by semicolons
+             */
+            void prepare(const std::string& sql);
+
+            /**
+             * @brief Binds the named parameter in all statements as string
+             *
+             * @param name the name including the prefix, e.g. :name
+             * @param value
+             */
+            void bindString(const std::string& name, const std::string& value);
+
+            /**
+             * @brief Binds the named parameter in all statements as integer
+             *
+             * @param name the name including the prefix, e.g. :name
+             * @param value
+             */
+            void bindInt(const std::string& name, const int value);
+
+            /**
+             * @brief Binds the named parameter in all statements as double
+             *
+             * @param name the name including the prefix, e.g. :name
+             * @param value
+             */
+            void bindDouble(const std::string& name, const double value);
+
+            /**
+             * @brief Binds the named parameter in all statements with the null value
+             *
+             * @param name the name including the prefix, e.g. :name
+             */
+            void bindNull(const std::string& name);
+
+            /**
+             * @brief executes all statements in order
+             *
+             * @return the number of changed rows of all statements
+             */
+            int exec(void);
+
+            /**
+             * @brief gets the statistics of the last execution, one entry
+             * per prepared statement
+             */
+            const std::vector<ScriptStatementStats>& getStats(void) const;
+
+            /**
+             * @brief releases all prepared statements
+             */
+            void finalize(void);
+    };
+
+
+    /**
+     * @brief settings of a CheckpointManager
+     */
+    struct CheckpointOptions {
+        /**
+         * @brief run a PASSIVE checkpoint, when the WAL has this many pages
+         */
+        int passivePages;
+
+        /**
+         * @brief run a RESTART checkpoint, when the WAL has grown to this many
+         * pages, because passive checkpoints could not keep up
+         */
+        int restartPages;
+
+        /**
+         * @brief run a TRUNCATE checkpoint, when the WAL has grown to this many pages
+         */
+        int truncatePages;
+
+        /**
+         * @brief the maximum time in milliseconds between a commit and the
+         * next checkpoint, regardless of the WAL size
+         */
+        long interval;
+
+        /**
+         * @brief the time in milliseconds RESTART and TRUNCATE checkpoints wait
+         * for readers and writers. They block writers meanwhile, so the
+         * database connection needs a busy timeout (PRAGMA busy_timeout)
+         * at least as long.
+         */
+        long busyTimeout;
+
+        CheckpointOptions(void) : passivePages(1000), restartPages(4000),
+            truncatePages(16000), interval(1000), busyTimeout(100) {
+        }
+    };
+
+    /**
+     * @brief statistics of a CheckpointManager
+     */
+    struct CheckpointStats {
+        unsigned long passive;
+        unsigned long restart;
+        unsigned long truncate;
+
+        /**
+         * @brief checkpoints, that returned SQLITE_BUSY
+         */
+        unsigned long busy;
+
+        /**
+         * @brief the number of pages in the WAL after the last commit
+         */
+        int walPages;
+
+        /**
+         * @brief the approximate size of the WAL after the last commit in bytes
+         */
+        size_t walBytes;
+
+        /**
+         * @brief the frames in the WAL and the checkpointed frames after the
+         * last checkpoint
+         */
+        int lastLogFrames;
+        int lastCheckpointedFrames;
+
+        /**
+         * @brief checkpoint durations in seconds
+         */
+        double lastSeconds;
+        double maxSeconds;
+        double totalSeconds;
+    };
+
+    /**
+     * @brief Runs WAL checkpoints in a background thread
+     *
+     * The automatic checkpoint of the database connection is disabled, so
+     * commits never run a checkpoint themselves. Instead, a second
+     * connection checkpoints from a background thread, when the WAL hook
+     * reports enough pages or the interval has passed since a commit.
+     *
+     * The database must be a file in WAL mode and must stay open, until the
+     * manager has been destroyed.
+     */
+    class CheckpointManager {
+        private:
+            Database& db;
+
+            CheckpointOptions options;
+
+            /**
+             * @brief the connection used by the background thread
+             */
+            sqlite3* connection;
+
+            /**
+             * @brief the page size of the database in bytes
+             */
+            int pageSize;
+
+            /**
+             * @brief the automatic checkpoint setting to restore
+             */
+            int autocheckpoint;
+
+            std::atomic<int> walPages;
+            std::atomic<unsigned long> commits;
+            std::atomic<bool> requested;
+
+            bool stopping;
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::thread thread;
+
+            mutable std::mutex statsMutex;
+            CheckpointStats stats;
+
+            void run(void);
+
+            void checkpoint(void);
+
+            static int walHook(void* data, sqlite3* db, const char* database, int pages);
+
+            CheckpointManager(const CheckpointManager&);
+            CheckpointManager& operator=(const CheckpointManager&);
+
+        public:
+            /**
+             * @brief disables automatic checkpoints on db and starts the background thread
+             */
+            CheckpointManager(Database& db, const CheckpointOptions& options = CheckpointOptions());
+
+            /**
+             * @brief stops the background thread, runs a last passive checkpoint
+             * and restores automatic checkpoints
+             */
+            ~CheckpointManager(void);
+
+            /**
+             * @brief asks the background thread to checkpoint as soon as possible
+             */
+            void requestCheckpoint(void);
+
+            CheckpointStats getStats(void) const;
+    };
+
+
+    /**
+     * @brief Incremental I/O on a single blob
+     *
+     * Reads and writes parts of a blob without loading the whole value.
+     * Writes cannot change the size of a blob, so space has to be
+     * reserved before, e.g. with a ZeroBlob parameter.
+     */
+    class BlobHandle {
+        private:
+            Database& db;
+
+            sqlite3_blob* blob;
+
+            /**
+             * @brief the table, needed to invalidate the query cache on writes
+             */
+            std::string table;
+
+            /**
+             * @brief the schema and row, needed to record writes for the change stream
+             */
+            std::string schema;
+            sqlite3_int64 rowid;
+
+            /**
+             * @brief the offset of readChunk() and writeChunk()
+             */
+            int position;
+
+            inline void checkOpened() const;
+
+            BlobHandle(const BlobHandle&);
+            BlobHandle& operator=(const BlobHandle&);
+
+        public:
+            /**
+             * @brief opens the blob in the passed row
+             *
+             * @param db
+             * @param table
+             * @param column
+             * @param rowid
+             * @param writable true, if the blob is written
+             * @param database the schema, e.g. main or temp
+             */
+            BlobHandle(Database& db, const std::string& table, const std::string& column,
+                    const sqlite3_int64 rowid, const bool writable = false,
+                    const std::string& database = "main");
+
+            ~BlobHandle(void);
+
+            /**
+             * @brief moves the handle to the same column of another row,
+             * faster than opening a new handle
+             */
+            void reopen(const sqlite3_int64 rowid);
+
+            /**
+             * @brief gets the size of the blob in bytes
+             */
+            int size(void) const;
+
+            /**
+             * @brief reads bytes at the passed offset
+             *
+             * @return the number of bytes read, less than size at the end of the blob
+             */
+            int read(void* buffer, const int size, const int offset);
+
+            /**
+             * @brief writes bytes at the passed offset. Throws an exception, if
+             * the data does not fit into the blob.
+             */
+            void write(const void* data, const int size, const int offset);
+
+            /**
+             * @brief reads the next chunk, starting at the beginning of the blob
+             *
+             * For example: while((n = blob.readChunk(buffer, sizeof(buffer))) > 0)
+             *
+             * @return the number of bytes read, 0 at the end of the blob
+             */
+            int readChunk(void* buffer, const int size);
+
+            /**
+             * @brief writes the next chunk, starting at the beginning of the blob
+             */
+            void writeChunk(const void* data, const int size);
+
+            /**
+             * @brief sets the offset of the next readChunk() or writeChunk()
+             */
+            void seek(const int offset);
+
+            /**
+             * @brief closes the handle
+             */
+            void close(void);
+    };
+
+    /**
+     * @brief stream buffer reading and writing a BlobHandle in chunks
+     */
+    class BlobStreamBuf : public std::streambuf {
+        private:
+            BlobHandle& blob;
+
+            std::vector<char> buffer;
+
+            /**
+             * @brief the blob offset of the start of the buffer
+             */
+            int base;
+
+            /**
+             * @brief the current offset in the blob
+             */
+            int tell(void) const;
+
+            /**
+             * @brief writes the put area into the blob and empties both areas
+             */
+            void flush(void);
+
+        protected:
+            virtual int_type underflow(void);
+            virtual int_type overflow(int_type c);
+            virtual int sync(void);
+            virtual pos_type seekoff(off_type offset, std::ios_base::seekdir direction,
+                    std::ios_base::openmode which);
+            virtual pos_type seekpos(pos_type position, std::ios_base::openmode which);
+
+        public:
+            BlobStreamBuf(BlobHandle& blob, const size_t chunk = 64 * 1024);
+
+            virtual ~BlobStreamBuf(void);
+    };
+
+    /**
+     * @brief A std::iostream on a blob. Only chunk sized parts of the blob
+     * are held in memory.
+     */
+    class BlobStream : public std::iostream {
+        private:
+            BlobStreamBuf buffer;
+
+        public:
+            BlobStream(BlobHandle& blob, const size_t chunk = 64 * 1024);
+    };
+
+
+    class SQLiteException : public std::exception {
+        private:
+            std::string error;
+
+        public:
+            /**
+             * @brief Constructs a SQLiteException with the passed error message
+             */
+            SQLiteException(const std::string& str) {
+                this->error = str;
+            }
+
+            /**
+             * @brief The error message is the last sqlite error in the
+             * passed sqlite database.
+             *
+             * @param db
+             */
+            SQLiteException(sqlite3* db) {
+                this->error = std::string(sqlite3_errmsg(db));
+            }
+
+            virtual ~SQLiteException() throw() {
+            }
+
+            /**
+             * @brief gets the error message
+             */
+            virtual const char* what() const throw() {
                 return this->error.c_str();
             }
     };
 
+    /**
+     * @brief thrown, if a query has been stopped because its deadline passed
+     */
+    class QueryTimeout : public SQLiteException {
+        public:
+            QueryTimeout(void) : SQLiteException("The query has timed out.") {
+            }
+    };
+
+    /**
+     * @brief thrown, if a query has been stopped by a CancellationToken or
+     * Database::interrupt()
+     */
+    class QueryInterrupted : public SQLiteException {
+        public:
+            QueryInterrupted(void) : SQLiteException("The query has been interrupted.") {
+            }
+    };
+
     extern SQLiteException DatabaseNotOpened;
     extern SQLiteException DatabaseOpened;
     extern SQLiteException StatementNotPrepared;
+    extern SQLiteException BlobNotOpened;
 }
 
 #endif
@@ -30,6 +30,10 @@ namespace sqlitepp {
         }
     }
 
+    static sqlite3_destructor_type toDestructor(const Ownership ownership) {
+        return (ownership == REFERENCE) ? SQLITE_STATIC : SQLITE_TRANSIENT;
+    }
+
     Statement::Statement(Database& database) : db(database) {
         if(!db.isOpen()) {
             throw DatabaseNotOpened;
@@ -37,6 +41,13 @@ namespace sqlitepp {
 
         this->finalized = true;
         this->statement = NULL;
+        this->cacheable = false;
+        this->running = false;
+        this->cachedRow = 0;
+        this->pendingEpoch = 0;
+        this->changeMark = 0;
+        this->timeout = -1;
+        this->token = NULL;
     }
 
     void Statement::exec() {
@@ -51,12 +62,44 @@ namespace sqlitepp {
             std::cout << "The statement has not been finalized! Memory leak!" << std::endl;
         }
 
-        this->lastResult = sqlite3_prepare_v2(this->db.database, str.c_str(), str.size(),
-                &this->statement, NULL);
-
+        this->access = TableAccess();
+        this->lastResult = this->db.prepare(str.c_str(), str.size(), &this->statement, NULL,
+                this->access);
 
         if(this->lastResult == SQLITE_OK) {
             this->finalized = false;
+            this->running = false;
+
+            this->parameterIndices.clear();
+            int count = this->statement ? sqlite3_bind_parameter_count(this->statement) : 0;
+            for(int index = 1; index <= count; ++index) {
+                const char* name = sqlite3_bind_parameter_name(this->statement, index);
+                if(name) {
+                    // also accept the name without :, @ or $
+                    this->parameterIndices.insert(std::pair<std::string, int>(name, index));
+                    this->parameterIndices.insert(std::pair<std::string, int>(name + 1, index));
+                }
+            }
+
+            this->cacheable = this->db.cache && this->statement
+                && sqlite3_stmt_readonly(this->statement)
+                && sqlite3_column_count(this->statement) > 0
+                && this->access.deterministic
+                && !this->access.reads.empty();
+
+            if(this->cacheable || this->db.plans) {
+                this->sql = str;
+            } else {
+                this->sql.clear();
+            }
+
+            if(this->cacheable) {
+                this->parameters.assign(sqlite3_bind_parameter_count(this->statement), "n");
+            }
+
+            if(this->db.plans && this->statement) {
+                this->db.plans->analyze(this->db.database, str);
+            }
         } else {
             throw SQLiteException(this->db.database);
         }
@@ -65,10 +108,30 @@ namespace sqlitepp {
     StepValue Statement::step() {
         this->checkPrepared();
 
-        this->lastResult = sqlite3_step(this->statement);
+        // a new query starts, unless the statement is in the middle of one
+        if(!sqlite3_stmt_busy(this->statement)) {
+            this->deadline = this->db.getDeadline(this->timeout);
+        }
+
+        this->lastResult = this->db.step(this->statement, this->access, this->changeMark,
+                this->deadline, this->token ? this->token : this->db.token);
 
         switch(this->lastResult) {
             case SQLITE_DONE:
+                if(this->pending && this->db.cache) {
+                    this->db.cache->insert(this->getCacheKey(), this->pending,
+                            this->access.reads, this->pendingEpoch);
+                }
+                this->pending.reset();
+                this->running = false;
+
+                if(this->db.cache) {
+                    this->db.cache->invalidate(this->access);
+                }
+
+                if(this->db.plans && !this->sql.empty()) {
+                    this->db.plans->record(this->sql, this->statement, true);
+                }
                 return DONE;
 
             case SQLITE_ROW:
@@ -83,9 +146,27 @@ namespace sqlitepp {
                             std::pair<std::string, int>(p, index));
                     }
                 }
+
+                // the cache may have been disabled while the query runs
+                if(this->pending && this->db.cache) {
+                    this->materializeRow();
+                }
                 return ROW;
 
+            case SQLITE_INTERRUPT:
+                sqlite3_reset(this->statement);
+                this->pending.reset();
+                this->running = false;
+                this->db.throwInterrupted();
+                return UNKNOWN;
+
             default:
+                this->pending.reset();
+                this->running = false;
+
+                if(this->db.cache) {
+                    this->db.cache->invalidate(this->access);
+                }
                 return UNKNOWN;
         }
     }
@@ -93,9 +174,152 @@ namespace sqlitepp {
     bool Statement::fetchRow(void) {
         this->checkPrepared();
 
+        if(!this->running) {
+            this->running = true;
+            this->cachedRow = 0;
+            this->lookupCache();
+        } else if(this->cached) {
+            this->cachedRow++;
+        }
+
+        if(this->cached) {
+            if(this->cachedRow < this->cached->rows) {
+                return true;
+            }
+
+            this->cached.reset();
+            this->running = false;
+            return false;
+        }
+
         return (this->step() == ROW);
     }
 
+    std::string Statement::getCacheKey(void) const {
+        std::string key(this->sql);
+        for(size_t i = 0; i < this->parameters.size(); ++i) {
+            key += '\0';
+            key += intToString(this->parameters[i].size());
+            key += ':';
+            key += this->parameters[i];
+        }
+        return key;
+    }
+
+    void Statement::setParameter(const int index, const std::string& value) {
+        if(this->cacheable && index >= 1 && index <= (int) this->parameters.size()) {
+            this->parameters[index - 1] = value;
+        }
+    }
+
+    bool Statement::lookupCache(void) {
+        this->cached.reset();
+        this->pending.reset();
+
+        if(!this->cacheable || !this->db.cache) {
+            return false;
+        }
+
+        this->cached = this->db.cache->lookup(this->getCacheKey());
+        if(this->cached) {
+            if(this->columns.size() == 0) {
+                for(int index = 0; index < this->cached->getColumnCount(); ++index) {
+                    this->columns.insert(this->columns.begin(),
+                        std::pair<std::string, int>(this->cached->getColumnName(index), index));
+                }
+            }
+            return true;
+        }
+
+        this->pending.reset(new ResultSet());
+        this->pending->setColumns(this->statement);
+        this->pendingEpoch = this->db.cache->getEpoch();
+        return false;
+    }
+
+    void Statement::materializeRow(void) {
+        if(!this->pending || !this->db.cache) {
+            this->pending.reset();
+            return;
+        }
+
+        this->pending->append(this->statement);
+
+        // give up early on results, that would not fit into the cache anyway
+        if(this->pending->size() > this->db.cache->getBudget()) {
+            this->pending.reset();
+        }
+    }
+
+    void Statement::fetchAll(ResultSet& result) {
+        this->checkPrepared();
+
+        result.clear();
+
+        if(!this->running) {
+            this->running = true;
+            this->cachedRow = 0;
+            this->lookupCache();
+        } else if(this->cached) {
+            this->cachedRow++;
+        }
+
+        if(this->cached) {
+            if(this->cachedRow == 0) {
+                result = *this->cached;
+            } else {
+                result.columns = this->cached->columns;
+                for(; this->cachedRow < this->cached->getRowCount(); ++this->cachedRow) {
+                    result.append(*this->cached, this->cachedRow);
+                }
+            }
+
+            this->cached.reset();
+            this->running = false;
+            return;
+        }
+
+        // On a cache miss, the rows are collected once by the pending result
+        // and copied at the end. Rows of earlier fetchRow() calls are skipped.
+        std::shared_ptr<ResultSet> pending = this->pending;
+        size_t first = pending ? pending->getRowCount() : 0;
+        size_t rows = 0;
+
+        // also names the columns of an empty result
+        result.setColumns(this->statement);
+        while(this->step() == ROW) {
+            rows++;
+
+            if(pending && this->pending) {
+                continue;
+            }
+
+            if(pending) {
+                // the pending result was dropped, take over its rows
+                for(size_t row = first; row < pending->getRowCount(); ++row) {
+                    result.append(*pending, row);
+                }
+                pending.reset();
+
+                if(result.getRowCount() == rows) {
+                    continue;
+                }
+            }
+
+            result.append(this->statement);
+        }
+
+        if(pending) {
+            if(first == 0) {
+                result = *pending;
+            } else {
+                for(size_t row = first; row < pending->getRowCount(); ++row) {
+                    result.append(*pending, row);
+                }
+            }
+        }
+    }
+
     int Statement::getInt(const std::string& name) const {
         this->checkPrepared();
 
@@ -108,6 +332,13 @@ namespace sqlitepp {
     int Statement::getInt(const int index) const {
         this->checkPrepared();
 
+        if(this->cached) {
+            if(index >= 0 && index < this->cached->getColumnCount()) {
+                return this->cached->getInt(this->cachedRow, index);
+            }
+            return 0;
+        }
+
         return sqlite3_column_int(this->statement, index);
     }
 
@@ -120,6 +351,13 @@ namespace sqlitepp {
     std::string Statement::getString(const int index) const {
         this->checkPrepared();
 
+        if(this->cached) {
+            if(index >= 0 && index < this->cached->getColumnCount()) {
+                return this->cached->getString(this->cachedRow, index);
+            }
+            return "NULL";
+        }
+
         const char* p = (const char*)sqlite3_column_text(this->statement, index);
         if(p) {
             return std::string(p);
@@ -155,6 +393,13 @@ namespace sqlitepp {
     double Statement::getDouble(const int index) const {
         this->checkPrepared();
 
+        if(this->cached) {
+            if(index >= 0 && index < this->cached->getColumnCount()) {
+                return this->cached->getDouble(this->cachedRow, index);
+            }
+            return 0.0;
+        }
+
         return sqlite3_column_double(this->statement, index);
     }
 
@@ -164,37 +409,184 @@ namespace sqlitepp {
         out = this->getDouble(index);
     }
 
+    const void* Statement::getBlob(const int index, int& size) const {
+        this->checkPrepared();
+
+        if(this->cached) {
+            if(index >= 0 && index < this->cached->getColumnCount()) {
+                return this->cached->getBlob(this->cachedRow, index, size);
+            }
+            size = 0;
+            return NULL;
+        }
+
+        const void* p = sqlite3_column_blob(this->statement, index);
+        size = sqlite3_column_bytes(this->statement, index);
+        return p;
+    }
+
+    const void* Statement::getBlob(const std::string& name, int& size) const {
+        this->checkPrepared();
+
+        std::map<std::string, int>::const_iterator column = this->columns.find(name);
+        if(column == this->columns.end()) {
+            throw SQLiteException("Unknown column " + name);
+        }
+        return this->getBlob(column->second, size);
+    }
+
     void Statement::bindInt(const int index, const int value) {
         this->checkPrepared();
 
         this->lastResult = sqlite3_bind_int(this->statement, index, value);
+        this->setParameter(index, "i" + intToString(value));
+    }
+
+    void Statement::bindInt64(const int index, const sqlite3_int64 value) {
+        this->checkPrepared();
+
+        this->lastResult = sqlite3_bind_int64(this->statement, index, value);
+        this->setParameter(index, "i" + longToString(value));
     }
 
-    void Statement::bindString(const int index, const std::string& value) {
+    void Statement::bindString(const int index, const std::string& value, const Ownership ownership) {
         this->checkPrepared();
 
-        this->lastResult = sqlite3_bind_text(this->statement, index, value.c_str(), value.size(), NULL);
+        this->lastResult = sqlite3_bind_text(this->statement, index, value.c_str(), value.size(),
+                toDestructor(ownership));
+        this->setParameter(index, "s" + value);
+    }
+
+    void Statement::bindBlob(const int index, const void* data, const int size, const Ownership ownership) {
+        this->checkPrepared();
+
+        // sqlite binds NULL for a NULL pointer, e.g. of an empty vector
+        if(size == 0) {
+            this->lastResult = sqlite3_bind_zeroblob(this->statement, index, 0);
+            this->setParameter(index, "b");
+            return;
+        }
+
+        this->lastResult = sqlite3_bind_blob(this->statement, index, data, size, toDestructor(ownership));
+        this->setParameter(index, "b" + std::string((const char*) data, size));
     }
 
     void Statement::bindDouble(const int index, const double value) {
         this->checkPrepared();
 
         this->lastResult = sqlite3_bind_double(this->statement, index, value);
+        this->setParameter(index, "d" + std::string((const char*) &value, sizeof(value)));
     }
 
     void Statement::bindNull(const int index) {
         this->checkPrepared();
 
         this->lastResult = sqlite3_bind_null(this->statement, index);
+        this->setParameter(index, "n");
+    }
+
+    void Statement::setTimeout(const long milliseconds) {
+        this->timeout = milliseconds;
+    }
+
+    void Statement::setCancellationToken(CancellationToken* token) {
+        this->token = token;
+    }
+
+    int Statement::getParameterIndex(const std::string& name) const {
+        this->checkPrepared();
+
+        std::map<std::string, int>::const_iterator it = this->parameterIndices.find(name);
+        if(it == this->parameterIndices.end()) {
+            throw SQLiteException("Unknown parameter " + name);
+        }
+        return it->second;
+    }
+
+    void Statement::bindString(const std::string& name, const std::string& value, const Ownership ownership) {
+        this->bindString(this->getParameterIndex(name), value, ownership);
+    }
+
+    void Statement::bindInt(const std::string& name, const int value) {
+        this->bindInt(this->getParameterIndex(name), value);
+    }
+
+    void Statement::bindInt64(const std::string& name, const sqlite3_int64 value) {
+        this->bindInt64(this->getParameterIndex(name), value);
+    }
+
+    void Statement::bindDouble(const std::string& name, const double value) {
+        this->bindDouble(this->getParameterIndex(name), value);
+    }
+
+    void Statement::bindBlob(const std::string& name, const void* data, const int size,
+            const Ownership ownership) {
+        this->bindBlob(this->getParameterIndex(name), data, size, ownership);
+    }
+
+    void Statement::bindNull(const std::string& name) {
+        this->bindNull(this->getParameterIndex(name));
+    }
+
+    void Statement::bind(const int index, const std::string& value) {
+        this->bindString(index, value);
+    }
+
+    void Statement::bind(const int index, const char* value) {
+        if(value) {
+            this->bindString(index, value);
+        } else {
+            this->bindNull(index);
+        }
+    }
+
+    void Statement::bind(const int index, const Text& value) {
+        this->checkPrepared();
+
+        this->lastResult = sqlite3_bind_text(this->statement, index, value.data, value.size,
+                toDestructor(value.ownership));
+        this->setParameter(index, "s" + std::string(value.data, value.size));
+    }
+
+    void Statement::bind(const int index, const Blob& value) {
+        this->bindBlob(index, value.data, value.size, value.ownership);
+    }
+
+    void Statement::bind(const int index, const std::vector<unsigned char>& value) {
+        this->bindBlob(index, value.empty() ? NULL : &value[0], value.size());
+    }
+
+    void Statement::bind(const int index, std::nullptr_t) {
+        this->bindNull(index);
+    }
+
+    void Statement::bind(const int index, const ZeroBlob& value) {
+        this->checkPrepared();
+
+        this->lastResult = sqlite3_bind_zeroblob(this->statement, index, value.size);
+        this->setParameter(index, "z" + intToString(value.size));
     }
 
     void Statement::finalize(void) {
         if(this->statement && !this->finalized) {
+            if(this->db.plans && !this->sql.empty()) {
+                this->db.plans->record(this->sql, this->statement, false);
+            }
+
             sqlite3_finalize(this->statement);
             this->columns.clear();
             this->statement = NULL;
             this->finalized = true;
         }
+
+        this->cached.reset();
+        this->pending.reset();
+        this->running = false;
+        this->cacheable = false;
+        this->parameters.clear();
+        this->parameterIndices.clear();
+        this->sql.clear();
+        this->access = TableAccess();
     }
 
     Statement::~Statement() {